@@ -1,3 +1,3 @@
 FetchContent_Declare(cli11 URL https://github.com/CLIUtils/CLI11/archive/refs/tags/v2.4.2.tar.gz)
 FetchContent_MakeAvailable(cli11)
-target_link_libraries(main PUBLIC CLI11::CLI11)
\ No newline at end of file
+target_link_libraries(loud PUBLIC CLI11::CLI11)
\ No newline at end of file
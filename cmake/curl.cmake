@@ -19,4 +19,4 @@ endif()
 add_compile_options(-w)
 
 FetchContent_MakeAvailable(curl)
-target_link_libraries(main PUBLIC CURL::libcurl)
\ No newline at end of file
+target_link_libraries(loud PUBLIC CURL::libcurl)
\ No newline at end of file
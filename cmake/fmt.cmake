@@ -1,3 +1,3 @@
 FetchContent_Declare(fmt URL https://github.com/fmtlib/fmt/archive/refs/tags/11.0.2.tar.gz)
 FetchContent_MakeAvailable(fmt)
-target_link_libraries(main PUBLIC fmt::fmt)
\ No newline at end of file
+target_link_libraries(loud PUBLIC fmt::fmt)
\ No newline at end of file
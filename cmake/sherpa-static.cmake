@@ -18,10 +18,10 @@ FetchContent_Declare(
     URL ${SHERPA_URL}
 )
 FetchContent_MakeAvailable(sherpa)
-target_include_directories(main PUBLIC ${sherpa_SOURCE_DIR}/include)
+target_include_directories(loud PUBLIC ${sherpa_SOURCE_DIR}/include)
 
 # Link sherpa
-target_link_directories(main PRIVATE ${sherpa_SOURCE_DIR}/lib)
+target_link_directories(loud PUBLIC ${sherpa_SOURCE_DIR}/lib)
 
 
 if (_WIN32)
@@ -29,7 +29,7 @@ if (_WIN32)
     set(SHERPA_ONNX_ENABLE_TTS OFF)
 endif()
 
-target_link_libraries(main PRIVATE 
+target_link_libraries(loud PUBLIC
     cargs
     espeak-ng
     kaldi-decoder-core
@@ -18,11 +18,11 @@ FetchContent_Declare(
     URL ${SHERPA_URL}
 )
 FetchContent_MakeAvailable(sherpa)
-target_include_directories(main PUBLIC ${sherpa_SOURCE_DIR}/include)
+target_include_directories(loud PUBLIC ${sherpa_SOURCE_DIR}/include)
 
 # Link sherpa
-target_link_directories(main PRIVATE ${sherpa_SOURCE_DIR}/lib)
-target_link_libraries(main PRIVATE
+target_link_directories(loud PUBLIC ${sherpa_SOURCE_DIR}/lib)
+target_link_libraries(loud PUBLIC
     sherpa-onnx-c-api
     cargs
     $<$<NOT:$<PLATFORM_ID:Windows>>:onnxruntime>
@@ -1,3 +1,3 @@
 FetchContent_Declare(spdlog URL https://github.com/gabime/spdlog/archive/refs/tags/v1.15.0.tar.gz)
 FetchContent_MakeAvailable(spdlog)
-target_link_libraries(main PUBLIC spdlog::spdlog)
\ No newline at end of file
+target_link_libraries(loud PUBLIC spdlog::spdlog)
\ No newline at end of file
@@ -4,6 +4,6 @@ FetchContent_Declare(subprocess URL https://github.com/benman64/subprocess/archi
 add_compile_options(-w)
 
 FetchContent_MakeAvailable(subprocess)
-target_include_directories(main PUBLIC ${subprocess_SOURCE_DIR}/src/cpp)
-target_link_libraries(main PRIVATE subprocess)
+target_include_directories(loud PUBLIC ${subprocess_SOURCE_DIR}/src/cpp)
+target_link_libraries(loud PRIVATE subprocess)
 
@@ -1,8 +1,22 @@
 
 # Add whisper lib
-FetchContent_Declare(whisper URL https://github.com/ggerganov/whisper.cpp/archive/f02b40bcb4849139fd7de2558aee64c737ab678e.zip)
+if(LOUD_CPU_DISPATCH)
+    # First release with loadable backends and CPU variants
+    # (ggml_backend_load), only the dispatch build needs it. The Linux
+    # release is built this way, see .github/workflows/release.yml.
+    # .github/workflows/test.yml builds, tests and runs both versions
+    FetchContent_Declare(whisper URL https://github.com/ggerganov/whisper.cpp/archive/refs/tags/v1.7.4.tar.gz)
 
-set(BUILD_SHARED_LIBS OFF CACHE BOOL "Build shared libraries" FORCE)
+    # Build the CPU kernels once per ISA level as loadable modules next to
+    # the binary, ggml loads the best one supported by cpuid at startup
+    set(BUILD_SHARED_LIBS ON CACHE BOOL "Build shared libraries" FORCE)
+    set(GGML_BACKEND_DL ON CACHE BOOL "")
+    set(GGML_CPU_ALL_VARIANTS ON CACHE BOOL "")
+    set(GGML_NATIVE OFF CACHE BOOL "")
+else()
+    FetchContent_Declare(whisper URL https://github.com/ggerganov/whisper.cpp/archive/f02b40bcb4849139fd7de2558aee64c737ab678e.zip)
+    set(BUILD_SHARED_LIBS OFF CACHE BOOL "Build shared libraries" FORCE)
+endif()
 set(WHISPER_BUILD_TESTS OFF CACHE BOOL "")
 set(WHISPER_BUILD_EXAMPLES OFF CACHE BOOL "")
 set(WHISPER_BUILD_SERVER OFF CACHE BOOL "")
@@ -25,12 +39,21 @@ endif()
 
 FetchContent_MakeAvailable(whisper)
 
-target_include_directories(main PUBLIC ${whisper_SOURCE_DIR}/include)
-target_include_directories(main PUBLIC ${whisper_SOURCE_DIR}/ggml/include)
+if(LOUD_CPU_DISPATCH)
+    target_compile_definitions(loud PRIVATE LOUD_CPU_DISPATCH)
+    # Ship whisper and ggml in bin/ with the backend modules
+    set_target_properties(whisper ggml ggml-base PROPERTIES
+        LIBRARY_OUTPUT_DIRECTORY ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}
+        RUNTIME_OUTPUT_DIRECTORY ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}
+    )
+endif()
+
+target_include_directories(loud PUBLIC ${whisper_SOURCE_DIR}/include)
+target_include_directories(loud PUBLIC ${whisper_SOURCE_DIR}/ggml/include)
 
 # Link whisper
 if(APPLE)
-    target_link_libraries(main PRIVATE
+    target_link_libraries(loud PRIVATE
         whisper
         ggml
         "-framework CoreFoundation"
@@ -38,7 +61,7 @@ if(APPLE)
         "-framework CoreML"
     )
 else()
-    target_link_libraries(main PRIVATE
+    target_link_libraries(loud PRIVATE
         whisper
         ggml
     )
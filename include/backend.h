@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace backend {
+
+// CPU kernel variants built next to the binary (haswell, skylakex, ...).
+// Empty unless built with LOUD_CPU_DISPATCH
+std::vector<std::string> cpu_variants();
+
+// Load a CPU variant before whisper picks the best one for this machine. It's
+// registered first, so whisper uses it. An empty variant keeps the default.
+// Fails if a different variant was loaded before
+bool load_cpu_variant(const std::string &variant);
+
+// Log the CPU backend whisper runs on and the features it was built for
+void log_cpu_backend();
+
+} // namespace backend
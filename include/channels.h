@@ -0,0 +1,48 @@
+#pragma once
+
+#include "diarization.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace channels {
+
+// Audio with each channel kept apart, 16kHz
+struct MultiChannelAudio {
+  std::vector<std::vector<float>> channels;
+  int32_t sample_rate = 0;
+  float offset = 0.0f; // Where the audio starts in the original file
+
+  int32_t num_samples() const {
+    return channels.empty() ? 0 : static_cast<int32_t>(channels[0].size());
+  }
+};
+
+// Speech detection by frame energy relative to the channel's noise floor
+struct EnergyConfig {
+  float frame_seconds = 0.03f;
+  float margin_db = 12.0f;    // Above the noise floor
+  float floor_db = -50.0f;    // Never speech below this, in dBFS
+  float crosstalk_db = 15.0f; // Quieter than the loudest channel is bleed
+  float min_silence_duration = 0.5f;
+  float min_speech_duration = 0.25f;
+  float padding = 0.2f;
+};
+
+// Read a PCM 16 bit or float wav file without downmixing. A start or end in
+// seconds seeks to that range of the data chunk, an end of 0 reads to the end
+std::unique_ptr<MultiChannelAudio> read_wav(const std::string &path,
+                                            float start = 0.0f,
+                                            float end = 0.0f);
+
+// Read any audio file, converting to 16kHz with ffmpeg when needed. Only the
+// range from start to end is decoded, see read_wav
+std::unique_ptr<MultiChannelAudio>
+prepare_audio_file(const std::string &audio_file, int argc, char *argv[],
+                   float start = 0.0f, float end = 0.0f);
+
+// Speech turns of each channel, with the channel index as the speaker
+std::vector<diarization::DiarizationSegment>
+speech_turns(const MultiChannelAudio &audio, const EnergyConfig &config = {});
+
+} // namespace channels
@@ -10,14 +10,22 @@
 namespace config {
 extern std::string ggml_tiny_url;
 extern std::string ggml_tiny_name;
+extern std::string ggml_tiny_sha256;
 
 extern std::string segmentation_url;
 extern std::string segmentation_name;
+extern std::string segmentation_sha256;
 
 extern std::string embedding_url;
 extern std::string embedding_name;
+extern std::string embedding_sha256;
+
+extern std::string vad_url;
+extern std::string vad_name;
+extern std::string vad_sha256;
 
 extern std::string ffmpeg_url;
 extern std::string ffmpeg_name;
+extern std::string ffmpeg_sha256;
 
 } // namespace config
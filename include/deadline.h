@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace deadline {
+
+// Ways to make a chunk cheaper to transcribe, taken in order as a run falls
+// behind its budget
+enum class Step {
+  no_fallback,       // No temperature fallbacks on failed decodes
+  reduced_audio_ctx, // Encoder context sized to the chunk
+  fallback_model,    // The smaller or quantized model
+};
+
+const char *step_name(Step step);
+
+// Tracks transcription against a time budget and picks how many steps to
+// take. The cost per second of audio is measured at the current level, the
+// level goes down when the audio left won't fit the time left and back up
+// when it would fit with plenty of room at the cost of the better level
+class Controller {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // budget_seconds counts from start, so time spent before transcription
+  // (decoding, diarization) is part of it
+  Controller(double budget_seconds, Clock::time_point start,
+             std::vector<Step> steps);
+
+  bool applies(Step step) const;
+  // Names of the steps in effect, empty at full quality
+  std::vector<std::string> active_steps() const;
+  int32_t level() const { return current; }
+
+  // Record a chunk transcribed at the current level, then re-plan for the
+  // audio left
+  void update(double audio_seconds, double elapsed, double remaining_audio);
+
+  int32_t decisions() const { return num_decisions; }
+
+private:
+  void change_level(int32_t level, double projected, double left);
+
+  double budget;
+  Clock::time_point start;
+  std::vector<Step> steps;
+  int32_t current = 0;
+  double cost = 0.0; // Seconds of work per second of audio
+  bool measured = false;
+  int32_t chunks_at_level = 0;
+  int32_t num_decisions = 0;
+  std::vector<double> level_costs; // Last cost measured at each level
+};
+
+} // namespace deadline
@@ -1,11 +1,10 @@
 #pragma once
-#include "spinner.h"
+#include "progress.h"
+#include <memory>
 #include <sherpa-onnx/c-api/c-api.h>
 #include <string>
 #include <vector>
 
-using spinner::Spinner;
-
 namespace diarization {
 
 struct DiarizationSegment {
@@ -14,6 +13,20 @@ struct DiarizationSegment {
   int32_t speaker;
 };
 
+// Diarize long audio in overlapping windows on several workers, then link
+// the per-window speakers globally by embedding centroid similarity
+struct WindowedConfig {
+  std::string segmentation_model_path;
+  std::string embedding_model_path;
+  std::string provider;
+  int32_t num_clusters = 4;
+  float window_seconds = 600.0f;
+  float overlap_seconds = 30.0f;
+  int32_t num_workers = 0;     // 0 picks one per hardware thread
+  int32_t onnx_num_threads = 1; // Split across the workers, 1 at least
+  float link_threshold = 0.5f;
+};
+
 const SherpaOnnxOfflineSpeakerDiarization *
 create_sd(const std::string &segmentation_model_path,
           const std::string &embedding_model_path, int32_t num_clusters,
@@ -21,14 +34,50 @@ create_sd(const std::string &segmentation_model_path,
 const SherpaOnnxWave *read_wave(const std::string &path);
 int32_t diarization_progress_callback(int32_t num_processed_chunk,
                                       int32_t num_total_chunks,
-                                      Spinner *spinner);
+                                      progress::Stage *stage);
 void print_segment(const DiarizationSegment &segment, const std::string &text);
 std::string get_default_provider();
-const SherpaOnnxWave *prepare_audio_file(const std::string &audio_file,
-                                         int argc, char *argv[]);
+// 16kHz mono audio, read by sherpa or decoded into samples
+class Audio {
+public:
+  explicit Audio(const SherpaOnnxWave *wave);
+  Audio(std::vector<float> samples, float offset);
+  ~Audio();
+
+  Audio(const Audio &) = delete;
+  Audio &operator=(const Audio &) = delete;
+
+  const SherpaOnnxWave *wave() const { return sherpa ? sherpa : &view; }
+
+  float offset = 0.0f; // Where the audio starts in the original file
+
+private:
+  const SherpaOnnxWave *sherpa = nullptr;
+  std::vector<float> samples;
+  SherpaOnnxWave view{};
+};
+
+// Read any audio file, converting to 16kHz mono with ffmpeg when needed. A
+// start or end in seconds decodes only that range, seeking in wav files and
+// in ffmpeg. An end of 0 reads to the end of the file
+std::unique_ptr<Audio> prepare_audio_file(const std::string &audio_file,
+                                          int argc, char *argv[],
+                                          float start = 0.0f,
+                                          float end = 0.0f);
+
+// Key of the diarization cache for a command line. An empty key disables the
+// cache
+std::string generate_cache_key(int argc, char *argv[]);
 
 const std::vector<DiarizationSegment>
-run_diarization(int argc, char *argv[],
+run_diarization(const std::string &cache_key,
                 const SherpaOnnxOfflineSpeakerDiarization *sd,
-                const SherpaOnnxWave *wave, Spinner &spinner);
+                const SherpaOnnxWave *wave, progress::Stage &stage);
+
+// Returns false if a worker fails. Audio without speech succeeds with no
+// segments
+bool run_windowed_diarization(
+    const std::string &cache_key, const WindowedConfig &config,
+    const SherpaOnnxWave *wave, progress::Stage &stage,
+    std::vector<DiarizationSegment> &diarization_segments);
 } // namespace diarization
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "diarization.h"
+#include "progress.h"
+#include "transcriber.h"
+#include <memory>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+
+namespace diarizer {
+
+// Who spoke when in 16kHz mono audio. A diarizer isn't called from several
+// threads at once
+class Diarizer {
+public:
+  virtual ~Diarizer() = default;
+
+  // A non empty cache_key reuses results of earlier runs with the same key
+  virtual bool
+  diarize(const SherpaOnnxWave *wave, const std::string &cache_key,
+          progress::Stage &stage,
+          std::vector<diarization::DiarizationSegment> &segments) = 0;
+  virtual const char *name() const = 0;
+};
+
+// Sherpa's pyannote segmentation and embedding clustering. Audio longer than
+// config.window_seconds is diarized in windows, 0 disables windowing
+class SherpaDiarizer : public Diarizer {
+public:
+  // Returns nullptr if the models fail to load
+  static std::unique_ptr<SherpaDiarizer>
+  create(const diarization::WindowedConfig &config);
+  ~SherpaDiarizer() override;
+
+  SherpaDiarizer(const SherpaDiarizer &) = delete;
+  SherpaDiarizer &operator=(const SherpaDiarizer &) = delete;
+
+  bool diarize(const SherpaOnnxWave *wave, const std::string &cache_key,
+               progress::Stage &stage,
+               std::vector<diarization::DiarizationSegment> &segments) override;
+  const char *name() const override { return "sherpa"; }
+
+private:
+  SherpaDiarizer(const SherpaOnnxOfflineSpeakerDiarization *sd,
+                 diarization::WindowedConfig config);
+
+  const SherpaOnnxOfflineSpeakerDiarization *sd;
+  diarization::WindowedConfig config;
+};
+
+// Sleeps like a model and splits the audio into fixed turns that cycle
+// through the speakers
+class MockDiarizer : public Diarizer {
+public:
+  MockDiarizer(transcriber::MockConfig config, int32_t num_speakers,
+               float turn_seconds = 5.0f)
+      : config(config), num_speakers(num_speakers),
+        turn_seconds(turn_seconds) {}
+
+  bool diarize(const SherpaOnnxWave *wave, const std::string &cache_key,
+               progress::Stage &stage,
+               std::vector<diarization::DiarizationSegment> &segments) override;
+  const char *name() const override { return "mock"; }
+
+private:
+  transcriber::MockConfig config;
+  int32_t num_speakers;
+  float turn_seconds;
+};
+
+} // namespace diarizer
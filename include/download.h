@@ -1,8 +1,24 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace download {
-void download_file(std::string url, std::string path);
-void download_resources_if_needed();
-} // namespace download
\ No newline at end of file
+
+struct Resource {
+  std::string url;
+  std::string path;
+  std::string sha256; // Expected digest, empty to skip verification
+};
+
+// Download all resources concurrently. Each transfer writes to <path>.part,
+// resumes it with an HTTP range request when present, verifies the checksum
+// and renames it into place. A .part that can't be resumed is downloaded
+// again from the start. Returns false if any resource failed.
+bool download_files(const std::vector<Resource> &resources);
+bool download_file(std::string url, std::string path, std::string sha256 = "");
+// Download the missing models and ffmpeg. Those with a digest in config.cpp
+// are verified, the others are downloaded unverified with a warning. Returns
+// false if any failed
+bool download_resources_if_needed();
+} // namespace download
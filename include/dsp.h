@@ -0,0 +1,50 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dsp {
+
+// FFT of real input of any size. Even sizes are split radix 2, odd factors
+// fall back to a plain DFT, so sizes like 400 work too
+class FFT {
+public:
+  explicit FFT(size_t size);
+
+  // out receives size bins
+  void forward(const float *in, std::complex<float> *out) const;
+  size_t size() const { return n; }
+
+private:
+  void transform(const float *in, size_t length, size_t stride,
+                 std::complex<float> *out) const;
+
+  size_t n;
+  std::vector<std::complex<float>> twiddles;
+};
+
+// Power spectrum of Hann windowed frames, n_fft / 2 + 1 bins each
+class PowerSpectrum {
+public:
+  explicit PowerSpectrum(size_t n_fft);
+
+  // frame holds n_fft samples
+  void compute(const float *frame, float *power);
+  size_t num_bins() const { return fft.size() / 2 + 1; }
+
+private:
+  FFT fft;
+  std::vector<float> window;
+  std::vector<float> windowed;
+  std::vector<std::complex<float>> spectrum;
+};
+
+// AVX2 is picked at runtime on x86-64, so the default build uses it too
+float dot(const float *a, const float *b, int32_t n);
+int32_t dot_int8(const int8_t *a, const int8_t *b, int32_t n);
+// Kernels dot and dot_int8 run on this machine: avx2, sse2, neon or scalar
+const char *simd_path();
+
+} // namespace dsp
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "diarization.h"
+#include <functional>
+#include <map>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+
+namespace embedding {
+
+const SherpaOnnxSpeakerEmbeddingExtractor *
+create_extractor(const std::string &embedding_model_path,
+                 const std::string &provider, int32_t onnx_num_threads);
+
+// Compute a L2 normalized speaker embedding of a mono 16kHz buffer.
+// Returns an empty vector if the buffer is too short for the extractor
+std::vector<float>
+compute_embedding(const SherpaOnnxSpeakerEmbeddingExtractor *extractor,
+                  const float *samples, int32_t n_samples);
+
+// Stand-in for the speaker model with the mock backends: the normalized
+// energy of 100Hz pitch bands up to 1.6kHz, so steady tones of different
+// pitch are told apart like voices
+std::vector<float> mock_embedding(const float *samples, int32_t n_samples);
+
+// Embeds a mono 16kHz buffer, empty if it's too short
+using Embed = std::function<std::vector<float>(const float *, int32_t)>;
+
+float cosine_similarity(const std::vector<float> &a,
+                        const std::vector<float> &b);
+
+void normalize(std::vector<float> &v);
+
+// Average the embeddings of each speaker's longest segments into a
+// normalized centroid. Timestamps are relative to samples
+std::map<int32_t, std::vector<float>>
+speaker_centroids(const SherpaOnnxSpeakerEmbeddingExtractor *extractor,
+                  const float *samples, int32_t n_samples,
+                  const std::vector<diarization::DiarizationSegment> &segments,
+                  int32_t max_segments_per_speaker = 8);
+std::map<int32_t, std::vector<float>>
+speaker_centroids(const Embed &embed, const float *samples, int32_t n_samples,
+                  const std::vector<diarization::DiarizationSegment> &segments,
+                  int32_t max_segments_per_speaker = 8);
+
+// Assign local speaker IDs of a chunk to global speakers by centroid
+// similarity. New global speakers are created while below max_speakers (<= 0
+// for unlimited) and the best match is below threshold. Speakers of the same
+// chunk get distinct global speakers while any is free. Once max_speakers is
+// reached and all are taken, the remaining ones join their closest global
+// speaker, so the chunk's speakers merge. global_centroids is updated in
+// place with the running centroid of each global speaker
+std::map<int32_t, int32_t>
+link_speakers(const std::map<int32_t, std::vector<float>> &local_centroids,
+              std::vector<std::vector<float>> &global_centroids,
+              std::vector<int32_t> &global_weights, float threshold,
+              int32_t max_speakers);
+
+} // namespace embedding
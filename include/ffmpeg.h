@@ -7,6 +7,10 @@ namespace ffmpeg {
 void show_ffmpeg_normalize_suggestion(const std::string &audio_path, int argc,
                                       char *argv[]);
 
-void normalize_audio(std::string input, std::string output);
+// Convert to 16kHz 16 bit wav, mono unless keep_channels is set. A start or
+// end in seconds converts only that range, an end of 0 converts to the end
+void normalize_audio(std::string input, std::string output,
+                     bool keep_channels = false, float start = 0.0f,
+                     float end = 0.0f);
 
 } // namespace ffmpeg
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fingerprint {
+
+// One 32 bit sub-fingerprint per 16ms of 16kHz audio. Each bit is the sign
+// of the energy difference between neighbouring bands across two frames, so
+// it survives gain changes and codec noise (Haitsma & Kalker)
+using Fingerprint = std::vector<uint32_t>;
+
+Fingerprint compute(const float *samples, int32_t n_samples);
+
+// Fraction of differing bits where b is shifted by offset frames against a.
+// overlap receives the number of compared frames
+float bit_error_rate(const Fingerprint &a, const Fingerprint &b,
+                     int32_t offset, int32_t &overlap);
+
+struct Stats {
+  int32_t lookups = 0;
+  int32_t hits = 0;
+  double hit_seconds = 0.0; // Audio that didn't go through whisper
+};
+
+// Persistent index of fingerprinted segments and their transcripts. Repeated
+// audio like IVR prompts is found by voting on matching sub-fingerprints,
+// then confirmed by the bit error rate of the aligned fingerprints
+class Index {
+public:
+  // Fails on an index saved for another model or language
+  bool load(const std::string &path);
+  // Merges the entries other runs saved to path since it was loaded
+  bool save(const std::string &path);
+
+  // What produced the transcripts, stored in the index header. Transcripts
+  // of another model or language are never reused
+  std::string model;
+  std::string language;
+
+  // Set text to the transcript of a confident match
+  bool lookup(const Fingerprint &query, std::string &text);
+  void add(Fingerprint fp, const std::string &text);
+
+  size_t size() const { return entries.size(); }
+  const Stats &stats() const { return counters; }
+
+  float max_bit_error_rate = 0.25f; // Unrelated audio is around 0.5
+  float min_coverage = 0.9f; // Of the longer of query and match
+  float min_seconds = 2.0f;  // Shorter segments aren't worth it
+  size_t max_entries = 20000;
+
+private:
+  struct Entry {
+    Fingerprint fp;
+    std::string text;
+    uint32_t hits = 0;
+    uint64_t last_used = 0;
+  };
+
+  void merge(const Index &other);
+  void post(uint32_t entry);
+  void rebuild();
+  void prune();
+
+  std::vector<Entry> entries;
+  bool foreign = false; // The last load found another model or language
+  // Sub-fingerprint halves to (entry, frame), every few frames of each entry
+  std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>>
+      postings;
+  uint64_t clock = 0;
+  Stats counters;
+};
+
+} // namespace fingerprint
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "dsp.h"
+#include <cstdint>
+#include <vector>
+
+// Cheap no-speech check of diarized segments before they reach the
+// transcriber. Breaths, clicks and line noise get a full whisper encode and
+// often come back empty or hallucinated. Speech has voiced frames: loud
+// enough, few zero crossings and a peaky, harmonic spectrum
+namespace gate {
+
+struct Config {
+  // Fraction of voiced frames below which a segment is skipped
+  float threshold = 0.1f;
+  // Frames quieter than this are silence
+  float floor_db = -50.0f;
+  // Zero crossings per sample above which a frame is noise or a fricative
+  float max_zcr = 0.25f;
+  // Spectral flatness, geometric over arithmetic mean power, above which a
+  // frame is noise. Voiced speech is far below it
+  float max_flatness = 0.3f;
+};
+
+struct Stats {
+  int32_t segments = 0;
+  int32_t skipped = 0;
+  double seconds = 0.0;
+  double skipped_seconds = 0.0;
+  double elapsed = 0.0; // Spent scoring
+};
+
+class Gate {
+public:
+  explicit Gate(Config config);
+
+  // Fraction of the voiced frames of 16kHz samples, 0 to 1
+  float score(const float *samples, int32_t n_samples);
+  // Whether samples are worth transcribing, counted in the stats
+  bool is_speech(const float *samples, int32_t n_samples);
+
+  const Stats &stats() const { return totals; }
+
+private:
+  Config config;
+  Stats totals;
+  dsp::PowerSpectrum spectrum;
+  std::vector<float> power;
+};
+
+} // namespace gate
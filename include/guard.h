@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <whisper.h>
+
+// Keeps whisper decodes from running away on silent or noisy chunks:
+// repetition loops and token floods end in an early end of text, hotter
+// retries are limited per run, and chunks decoding too long are aborted
+namespace guard {
+
+struct Config {
+  // Text tokens a chunk may decode per second of audio, on top of
+  // min_tokens. 0 disables the cap
+  float max_tokens_per_second = 10.0f;
+  int32_t min_tokens = 16;
+  // An n-gram of up to max_ngram tokens repeated over the last loop_tokens
+  // tokens, and at least 3 times, is a loop. 0 disables loop detection
+  int32_t max_ngram = 8;
+  int32_t loop_tokens = 12;
+  // Temperature fallback retries of a run, -1 for no limit. Checked before
+  // each chunk, so the chunk that runs it out may still retry
+  int32_t fallback_budget = -1;
+  // Seconds a chunk may decode before it's aborted, 0 for no limit
+  float chunk_timeout = 0.0f;
+};
+
+struct Stats {
+  int32_t chunks = 0;
+  int32_t loops = 0;      // Chunks with a decode ended on a loop
+  int32_t token_caps = 0; // Chunks with a decode ended on the token cap
+  int32_t retried = 0;    // Chunks whisper retried hotter
+  int32_t retries = 0;
+  int32_t denied = 0;  // Chunks decoded without retries, over the budget
+  int32_t aborted = 0; // Chunks aborted on the timeout
+};
+
+// What the guard cut a chunk's decode short on. Its text is truncated or
+// empty
+struct Outcome {
+  bool loop = false;
+  bool token_cap = false;
+  bool aborted = false;
+
+  bool cut() const { return loop || token_cap || aborted; }
+  // loop, token_cap and aborted, for the JSON output
+  std::vector<std::string> names() const;
+};
+
+// Guards the chunks of one run. Chunks are decoded one at a time, but the
+// decoders of a chunk call the logits filter from several threads at once
+class Guard {
+public:
+  explicit Guard(Config config) : config(config) {}
+
+  // Hook the guard into params for a chunk of audio_seconds. Without
+  // retries left, the chunk gets none
+  void begin_chunk(whisper_full_params &params, double audio_seconds);
+  // Count what happened to the chunk and return it
+  Outcome end_chunk();
+
+  bool retries_left() const;
+  const Stats &stats() const { return totals; }
+
+private:
+  static bool on_encoder_begin(whisper_context *ctx, whisper_state *state,
+                               void *user_data);
+  static bool on_abort(void *user_data);
+  static void on_logits(whisper_context *ctx, whisper_state *state,
+                        const whisper_token_data *tokens, int n_tokens,
+                        float *logits, void *user_data);
+  bool looping(const whisper_token_data *tokens, int n_tokens) const;
+
+  Config config;
+  Stats totals;
+
+  // The chunk being decoded
+  std::chrono::steady_clock::time_point chunk_start;
+  int32_t max_tokens = 0;
+  bool denied = false;
+  // Updated by the decoders
+  std::atomic<int32_t> pass_tokens{0}; // Most tokens of the current pass
+  std::atomic<int32_t> retries{0};
+  std::atomic<bool> loop{false};
+  std::atomic<bool> token_cap{false};
+  std::atomic<bool> aborted{false};
+};
+
+} // namespace guard
@@ -0,0 +1,155 @@
+#ifndef LOUD_H
+#define LOUD_H
+
+// C API of loud.cpp: diarize and transcribe audio from any language with a C
+// FFI. Models are loaded once by loud_engine_create and reused by every call
+
+#include <stdint.h>
+
+#ifdef LOUD_SHARED
+#ifdef _WIN32
+#ifdef LOUD_BUILD
+#define LOUD_API __declspec(dllexport)
+#else
+#define LOUD_API __declspec(dllimport)
+#endif
+#else
+#define LOUD_API __attribute__((visibility("default")))
+#endif
+#else
+#define LOUD_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct loud_engine;
+
+struct loud_engine_params {
+  const char *whisper_model_path;
+  const char *segmentation_model_path;
+  const char *embedding_model_path;
+  const char *language;
+  const char *onnx_provider;
+  int32_t num_speakers;
+  int32_t onnx_num_threads;
+
+  float diarization_window; // Seconds, 0 disables windowing
+  float diarization_window_overlap;
+  int32_t diarization_workers; // 0 picks one per hardware thread
+
+  int32_t use_vad;
+  const char *vad_model_path;
+  float vad_threshold;
+
+  const char *speaker_db_path; // NULL disables speaker naming
+  float speaker_threshold;
+  int32_t speaker_db_int8;
+
+  int32_t dynamic_audio_ctx;
+  int32_t channels_as_speakers; // Files are split by channel, no diarization
+  const char *dedup_index_path; // NULL disables transcript reuse
+
+  const char *cpu_variant; // NULL picks the best for this machine
+
+  // Time budget in seconds or as a multiple of the audio duration, 0
+  // disables. Segments transcribed cheaper to meet it are marked degraded
+  float deadline;
+  float target_rtf;
+  const char *deadline_model_path; // NULL never switches models
+
+  // Larger model for segments the first one is unsure of, NULL disables
+  const char *refine_model_path;
+  float refine_logprob_threshold;
+  float refine_compression_ratio;
+
+  // "whisper" or "sherpa" asr and "sherpa" diarization, or "mock" for
+  // backends that sleep for the audio duration times their rtf instead of
+  // running models
+  const char *asr_backend;
+  const char *diarization_backend;
+  float mock_asr_rtf;
+  float mock_diarization_rtf;
+
+  // Sherpa-onnx offline model directory and type (sense_voice, paraformer,
+  // moonshine or whisper) of the sherpa asr backend, and chunks per call
+  const char *sherpa_asr_model_path;
+  const char *sherpa_asr_model_type;
+  int32_t asr_batch_size;
+
+  // Compute whisper's log mel spectrogram once per audio
+  int32_t shared_mel;
+
+  // End looping decodes early, limit fallback retries per call (-1 for no
+  // limit) and abort chunks decoding longer than a timeout (0 for none)
+  int32_t decode_guard;
+  int32_t fallback_budget;
+  float decode_timeout;
+
+  // RTTM file of the speaker turns to transcribe instead of diarizing, in
+  // file time. NULL diarizes
+  const char *diarization_input_path;
+
+  // Transcribe overlapping turns' audio once, as overlapped speech
+  int32_t resolve_overlaps;
+
+  // Skip segments with fewer voiced frames than this fraction, 0 disables
+  float speech_gate;
+};
+
+// Strings are only valid during the callback
+struct loud_segment {
+  float start; // Seconds
+  float end;
+  int32_t speaker;
+  const char *speaker_name; // NULL when the speaker isn't enrolled
+  const char *text;
+};
+
+typedef void (*loud_segment_callback)(const struct loud_segment *segment,
+                                      void *user_data);
+
+LOUD_API struct loud_engine_params loud_engine_default_params(void);
+
+// Returns NULL if a model fails to load
+LOUD_API struct loud_engine *
+loud_engine_create(const struct loud_engine_params *params);
+LOUD_API void loud_engine_free(struct loud_engine *engine);
+
+// Process 16kHz mono samples in [-1, 1]. Segments are passed to callback as
+// they're transcribed. Returns 0 on success
+LOUD_API int loud_engine_process_pcm(struct loud_engine *engine,
+                                     const float *samples, int32_t n_samples,
+                                     loud_segment_callback callback,
+                                     void *user_data);
+
+// Process planar 16kHz channels, each channel is one speaker. Diarization is
+// skipped. Returns 0 on success
+LOUD_API int loud_engine_process_channels(struct loud_engine *engine,
+                                          const float *const *channels,
+                                          int32_t n_channels,
+                                          int32_t n_samples,
+                                          loud_segment_callback callback,
+                                          void *user_data);
+
+// Process an audio file. Files other than 16kHz wav need ffmpeg in PATH
+LOUD_API int loud_engine_process_file(struct loud_engine *engine,
+                                      const char *path,
+                                      loud_segment_callback callback,
+                                      void *user_data);
+
+// Process the range from start to end seconds of an audio file, seeking
+// instead of decoding the rest. An end of 0 reads to the end of the file.
+// Timestamps are in file time
+LOUD_API int loud_engine_process_file_range(struct loud_engine *engine,
+                                            const char *path, float start,
+                                            float end,
+                                            loud_segment_callback callback,
+                                            void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOUD_H
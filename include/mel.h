@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Whisper's log mel spectrogram of a whole wave, computed once and sliced
+// per chunk instead of whisper recomputing it over each padded chunk
+namespace mel {
+
+constexpr int32_t n_fft = 400;
+constexpr int32_t hop_length = 160;
+
+// Slaney mel filters over the n_fft / 2 + 1 power bins of 16kHz audio, as
+// librosa builds them and OpenAI's models use them. [n_mel][bins]
+std::vector<float> slaney_filters(int32_t n_mel);
+
+// The mel filters stored in a ggml whisper model file, which whisper uses
+// for its own spectrogram. Returns false if the file has no n_mel filters
+// over n_fft / 2 + 1 bins
+bool load_filters(const std::string &model_path, int32_t n_mel,
+                  std::vector<float> &filters);
+
+class Spectrogram {
+public:
+  // Frames centred every hop_length samples through model_filters, computed
+  // on num_threads. Empty filters use slaney_filters. Slices read samples
+  // again, they have to outlive the spectrogram
+  Spectrogram(const float *samples, int32_t n_samples, int32_t n_mel,
+              int32_t num_threads, std::vector<float> model_filters = {});
+
+  // Frames of [start_sample, end_sample) followed by silence up to
+  // num_frames, normalized like whisper normalizes a chunk. out receives
+  // them in whisper_set_mel's [n_mel][num_frames] layout
+  void slice(int32_t start_sample, int32_t end_sample, int32_t num_frames,
+             std::vector<float> &out);
+
+  int32_t n_mel() const { return mels; }
+  int32_t n_frames() const { return frames; }
+
+private:
+  const float *samples;
+  int32_t mels;
+  int32_t frames;
+  std::vector<float> filters;
+  std::vector<std::pair<int32_t, int32_t>> ranges; // Non zero bins
+  std::vector<float> data;  // log10 power, [frame][n_mel]
+  std::vector<float> edges; // Frames of the last slice
+};
+
+} // namespace mel
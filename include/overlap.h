@@ -0,0 +1,28 @@
+#pragma once
+
+#include "diarization.h"
+#include <cstdint>
+#include <vector>
+
+// Diarization segments overlap during crosstalk, transcribing each of them
+// passes the shared audio through the model once per speaker. Spans cut the
+// timeline where the set of speakers changes, so each stretch of audio is
+// transcribed once
+namespace overlap {
+
+// A stretch of audio with the same speakers throughout, ordered by when
+// their segments started. More than one speaker is overlapped speech
+struct Span {
+  float start;
+  float end;
+  std::vector<int32_t> speakers;
+};
+
+// Spans of the segments, in time order. Spans shorter than min_seconds are
+// absorbed by an adjacent span sharing a speaker instead of being cut off,
+// so a short crosstalk goes to the turn around it
+std::vector<Span>
+resolve(const std::vector<diarization::DiarizationSegment> &segments,
+        float min_seconds);
+
+} // namespace overlap
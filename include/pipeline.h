@@ -0,0 +1,202 @@
+#pragma once
+
+#include "channels.h"
+#include "config.h"
+#include "deadline.h"
+#include "diarizer.h"
+#include "fingerprint.h"
+#include "guard.h"
+#include "segments.h"
+#include "speakers.h"
+#include "transcriber.h"
+#include "vad.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+
+namespace pipeline {
+
+struct Options {
+  std::string whisper_model_path = config::ggml_tiny_name;
+  std::string segmentation_model_path = config::segmentation_name;
+  std::string embedding_model_path = config::embedding_name;
+  std::string language = "en";
+  std::string onnx_provider = diarization::get_default_provider();
+  int32_t num_speakers = 4;
+  int32_t onnx_num_threads = 4;
+
+  float diarization_window = 0.0f; // Seconds, 0 disables windowing
+  float diarization_window_overlap = 30.0f;
+  int32_t diarization_workers = 0;
+
+  bool use_vad = false;
+  std::string vad_model_path = config::vad_name;
+  float vad_threshold = 0.5f;
+
+  std::string speaker_db_path; // Empty disables speaker naming
+  float speaker_threshold = 0.6f;
+  bool speaker_db_int8 = false;
+
+  bool dynamic_audio_ctx = false;
+  // Compute whisper's log mel spectrogram of the audio once and give each
+  // chunk a slice of it
+  bool shared_mel = false;
+
+  // Fingerprint index of transcribed segments, empty disables reuse
+  std::string dedup_index_path;
+
+  // Each channel is one speaker, skips diarization
+  bool channels_as_speakers = false;
+
+  // RTTM file of the audio's speaker turns in file time, eg. from a
+  // telephony platform or another machine, used instead of diarizing
+  std::string diarization_input_path;
+  // Only diarize, the transcribers aren't loaded and process fails
+  bool diarization_only = false;
+  // Transcribe the audio of overlapping turns once, as overlapped speech
+  bool resolve_overlaps = false;
+
+  // Time budget of a process call in seconds, or as a multiple of the audio
+  // duration. Chunks get cheaper as the run falls behind it. 0 disables
+  float deadline = 0.0f;
+  float target_rtf = 0.0f;
+  // Smaller or quantized whisper model for runs far behind the budget
+  std::string deadline_model_path;
+
+  // Larger whisper model to re-transcribe chunks the first model is unsure
+  // of, by mean token log probability or compression ratio. Empty disables
+  std::string refine_model_path;
+  float refine_logprob_threshold = -1.0f;
+  float refine_compression_ratio = 2.4f;
+
+  // Speech to text and diarization engines. The mock ones sleep for the
+  // audio duration times their rtf and return deterministic output, to
+  // measure the pipeline without models
+  std::string asr_backend = "whisper";       // whisper, sherpa or mock
+  std::string diarization_backend = "sherpa"; // sherpa or mock
+  float mock_asr_rtf = 0.05f;
+  float mock_diarization_rtf = 0.02f;
+
+  // Sherpa-onnx offline model directory of the sherpa asr backend. The
+  // deadline and refine models are directories of the same type with it
+  std::string sherpa_asr_model_path;
+  std::string sherpa_asr_model_type = "sense_voice";
+  int32_t asr_batch_size = 16; // Chunks decoded per call by sherpa
+
+  // End whisper decodes that loop or flood tokens early, limit the
+  // temperature fallback retries of a call (-1 for no limit) and abort
+  // chunks decoding longer than decode_timeout seconds (0 for no limit)
+  bool decode_guard = false;
+  int32_t fallback_budget = -1;
+  float decode_timeout = 0.0f;
+
+  // Skip segments with fewer voiced frames than this fraction, by their
+  // energy, zero crossings and spectral flatness. 0 disables
+  float speech_gate = 0.0f;
+
+  // ggml CPU kernel variant to use instead of the best one for this machine
+  std::string cpu_variant;
+
+  // Print the CLI status lines (diarization complete, no speech) to stdout
+  bool print_status = false;
+};
+
+// Loaded models and the diarize, identify and transcribe pipeline over them.
+// Models are loaded once and reused for every call. Calls are serialized,
+// whisper and sherpa contexts aren't safe to share between threads
+class Engine {
+public:
+  explicit Engine(Options options);
+  ~Engine();
+
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
+  // Load the transcribers, the diarizer and the speaker index
+  bool load();
+
+  // Diarize and transcribe 16kHz mono audio into result. on_segment is called
+  // with each segment as soon as it's transcribed. A non empty cache_key
+  // reuses diarization results of earlier runs with the same key. Timestamps
+  // are shifted by offset, for audio that starts later in the original file.
+  // turns receives the speaker turns transcribed, in file time. The deadline
+  // counts from started, eg. before the audio was decoded, or from the call
+  // when it's left default
+  bool process(const SherpaOnnxWave *wave, nlohmann::ordered_json &result,
+               const segments::SegmentCallback &on_segment = nullptr,
+               const std::string &cache_key = "", float offset = 0.0f,
+               std::vector<diarization::DiarizationSegment> *turns = nullptr,
+               deadline::Controller::Clock::time_point started = {});
+
+  // Diarize 16kHz mono audio into speaker turns in file time, without
+  // transcribing. names receives the speakers matching enrolled ones
+  bool diarize(const SherpaOnnxWave *wave,
+               std::vector<diarization::DiarizationSegment> &turns,
+               std::map<int32_t, std::string> &names,
+               const std::string &cache_key = "", float offset = 0.0f);
+
+  // Transcribe each channel's speech turns with the channel as the speaker.
+  // Turns are found with the vad if enabled, otherwise by energy
+  bool process_channels(const channels::MultiChannelAudio &audio,
+                        nlohmann::ordered_json &result,
+                        const segments::SegmentCallback &on_segment = nullptr,
+                        deadline::Controller::Clock::time_point started = {});
+
+  // Normalized embedding centroid of each speaker's turns, given in file
+  // time of audio that starts offset seconds into the file. The mock
+  // diarization backend uses embedding::mock_embedding instead of the model
+  std::map<int32_t, std::vector<float>>
+  speaker_centroids(const SherpaOnnxWave *wave,
+                    const std::vector<diarization::DiarizationSegment> &turns,
+                    float offset = 0.0f);
+
+  // Add the voice in wave to the speaker index under name and save it
+  bool enroll(const SherpaOnnxWave *wave, const std::string &name);
+
+  const Options &options() const { return opts; }
+  const speakers::SpeakerIndex &speaker_index() const { return index; }
+
+private:
+  bool load_speaker_index();
+  bool load_dedup_index();
+  void save_dedup_index();
+  std::unique_ptr<transcriber::Transcriber>
+  create_transcriber(const std::string &model_path);
+  std::unique_ptr<diarizer::Diarizer> create_diarizer();
+  std::unique_ptr<guard::Guard> create_guard() const;
+  std::unique_ptr<gate::Gate> create_gate() const;
+  segments::Options create_segment_options(
+      const segments::SegmentCallback &on_segment,
+      deadline::Controller *controller, guard::Guard *guard,
+      gate::Gate *gate);
+  std::unique_ptr<deadline::Controller>
+  create_deadline(float duration,
+                  deadline::Controller::Clock::time_point start) const;
+  bool run_diarizer(const SherpaOnnxWave *wave, const std::string &cache_key,
+                    std::vector<diarization::DiarizationSegment> &segments);
+  bool read_turns(const SherpaOnnxWave *wave, float offset,
+                  std::vector<diarization::DiarizationSegment> &turns,
+                  std::map<int32_t, std::string> &names) const;
+  std::unique_ptr<vad::CompactAudio> compact(const SherpaOnnxWave *wave) const;
+  std::map<int32_t, std::string> identify_speakers(
+      const SherpaOnnxWave *wave,
+      const std::vector<diarization::DiarizationSegment> &segments);
+
+  Options opts;
+  std::mutex mutex;
+  std::unique_ptr<transcriber::Transcriber> asr;
+  std::unique_ptr<transcriber::Transcriber> fallback_asr;
+  std::unique_ptr<transcriber::Transcriber> refine_asr;
+  std::unique_ptr<diarizer::Diarizer> diarizer;
+  const SherpaOnnxSpeakerEmbeddingExtractor *extractor = nullptr;
+  speakers::SpeakerIndex index;
+  bool index_loaded = false;
+  fingerprint::Index dedup;
+  bool dedup_loaded = false;
+};
+
+} // namespace pipeline
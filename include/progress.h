@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace progress {
+
+enum class Mode {
+  Off,  // No progress output
+  Tty,  // Animated spinner on stdout
+  Json, // One JSON object per line on a file descriptor
+};
+
+// Progress of one pipeline stage. Producers only touch the atomics, so it's
+// safe to update from callbacks and worker threads without locking
+struct Stage {
+  std::string name;  // Machine readable, used in JSON events
+  std::string label; // Shown next to the spinner
+  double audio_seconds = 0.0; // Audio covered by the stage, for RTF
+  std::chrono::steady_clock::time_point start_time;
+  std::atomic<int64_t> done{0};
+  std::atomic<int64_t> total{0};
+
+  void add(int64_t n = 1) { done.fetch_add(n, std::memory_order_relaxed); }
+  void update(int64_t new_done, int64_t new_total) {
+    total.store(new_total, std::memory_order_relaxed);
+    done.store(new_done, std::memory_order_relaxed);
+  }
+};
+
+// JSON when a file descriptor is given, spinner when stdout is a terminal,
+// otherwise nothing
+Mode detect_mode(int json_fd);
+
+// Start the reporter thread. Without it stages are still tracked but never
+// rendered
+void init(Mode mode, int json_fd = -1);
+void shutdown();
+
+// Make stage the one that's rendered. The returned stage stays valid until
+// it's passed to end()
+Stage &begin(const std::string &name, const std::string &label,
+             int64_t total = 0, double audio_seconds = 0.0);
+
+// Emit the final state of the stage, stop rendering it and release it
+void end(Stage &stage);
+
+// Hold while printing to stdout so lines don't mix with the spinner
+std::unique_lock<std::mutex> pause();
+
+} // namespace progress
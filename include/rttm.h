@@ -0,0 +1,28 @@
+#pragma once
+
+#include "diarization.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// NIST RTTM speaker turns, the format diarization tools and telephony
+// platforms exchange. Each turn is a line of
+// SPEAKER <file> 1 <start> <duration> <NA> <NA> <speaker> <NA> <NA>
+namespace rttm {
+
+// Read the SPEAKER lines of path into turns sorted by start. Speakers
+// labelled by a number (eg. 3, speaker_03, spk3) keep it, other labels get
+// the lowest free numbers in order of first appearance and are kept in
+// names. Fails if the turns are of more than one file id
+bool load(const std::string &path,
+          std::vector<diarization::DiarizationSegment> &turns,
+          std::map<int32_t, std::string> &names);
+
+// Write turns as file_id's. Speakers are labelled by their name in names,
+// or as speaker_<number>
+bool save(const std::string &path, const std::string &file_id,
+          const std::vector<diarization::DiarizationSegment> &turns,
+          const std::map<int32_t, std::string> &names = {});
+
+} // namespace rttm
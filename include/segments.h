@@ -1,18 +1,60 @@
 #pragma once
 
+#include "deadline.h"
 #include "diarization.h"
+#include "fingerprint.h"
+#include "gate.h"
+#include "guard.h"
 #include "sherpa-onnx/c-api/c-api.h"
-#include "whisper.h"
+#include "transcriber.h"
+#include <functional>
+#include <map>
 #include <nlohmann/json.hpp>
+#include <string>
 
 namespace segments {
 
+// Maps timestamps of the processed audio back to the original file
+using TimeMap = std::function<float(float seconds, bool is_end)>;
+
+// Called with each transcribed segment as it's added to the result
+using SegmentCallback = std::function<void(const nlohmann::ordered_json &)>;
+
+struct Options {
+  // Size whisper's encoder context to each segment instead of padding it to
+  // 30 seconds
+  bool dynamic_audio_ctx = false;
+  // Names of identified speakers, added as "speaker_name"
+  std::map<int32_t, std::string> speaker_names;
+  SegmentCallback on_segment;
+  // Reuse transcripts of audio seen before, and remember new ones
+  fingerprint::Index *dedup = nullptr;
+  // Make chunks cheaper as the run falls behind its time budget. Segments of
+  // degraded chunks list the steps taken as "degraded"
+  deadline::Controller *deadline = nullptr;
+  // Smaller or quantized model for the fallback_model step
+  transcriber::Transcriber *fallback = nullptr;
+  // Larger model for chunks the first model is unsure of. Those segments are
+  // marked "refined"
+  transcriber::Transcriber *refine = nullptr;
+  float refine_logprob_threshold = -1.0f;
+  float refine_compression_ratio = 2.4f;
+  // Stops runaway whisper decodes and limits the run's fallback retries.
+  // The refine model has its own, so its chunks are counted once
+  guard::Guard *guard = nullptr;
+  guard::Guard *refine_guard = nullptr;
+  // Transcribe overlapping segments' shared audio once. Segments of
+  // overlapped speech list all the speakers as "speakers" and are marked
+  // "overlap", "speaker" is the one who was speaking first
+  bool resolve_overlaps = false;
+  // Skips segments that are confidently not speech
+  gate::Gate *gate = nullptr;
+};
+
 // Function to process all segments and return a JSON result
 nlohmann::ordered_json process_segments(
     std::vector<diarization::DiarizationSegment> segments,
-    const SherpaOnnxWave *wave, // Assuming Wave is a defined struct or class
-    whisper_context *ctx,       // Assuming Context is a defined struct or class
-    whisper_full_params params  // Assuming Params is a defined struct or class
-);
+    const SherpaOnnxWave *wave, transcriber::Transcriber &transcriber,
+    const TimeMap &time_map = nullptr, const Options &options = {});
 
 } // namespace segments
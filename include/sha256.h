@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sha256 {
+
+// Incremental SHA-256 (FIPS 180-4) used to verify downloaded resources
+class Hasher {
+public:
+  Hasher();
+
+  void update(const void *data, size_t size);
+
+  // Finish the digest and return it as lowercase hex
+  std::string hex_digest();
+
+private:
+  void transform(const uint8_t *block);
+
+  std::array<uint32_t, 8> state;
+  std::array<uint8_t, 64> buffer;
+  uint64_t total_size;
+  size_t buffer_size;
+};
+
+// Hash a whole file. Returns an empty string if the file can't be read
+std::string file_digest(const std::string &path);
+
+} // namespace sha256
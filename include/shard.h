@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+
+// Split one long recording into time shards processed on separate machines,
+// then merge their results. Shards overlap by a margin on each side so turns
+// cut at a shard boundary are whole in one of them. Each shard owns the
+// audio up to the boundary, and speakers are linked across shards by their
+// embedding centroids
+namespace shard {
+
+// Normalized embedding centroid of each speaker of a result
+using Centroids = std::map<int32_t, std::vector<float>>;
+
+struct Shard {
+  // Audio, JSON result and centroids of the shard, relative to the manifest
+  std::string audio;
+  std::string json;
+  std::string centroids;
+  // Seconds of the source the audio covers, margins included
+  float start = 0.0f;
+  float end = 0.0f;
+  // Seconds of the source whose segments are taken from this shard
+  float own_start = 0.0f;
+  float own_end = 0.0f;
+};
+
+struct Manifest {
+  std::string source;
+  float duration = 0.0f;
+  float margin = 0.0f;
+  std::vector<Shard> shards;
+};
+
+// Shards of shard_seconds with margin seconds of overlap on each side, named
+// after the source's stem
+Manifest plan(const std::string &source, float duration, float shard_seconds,
+              float margin);
+
+// Write the shards' 16kHz mono audio and the manifest into dir
+bool write(const SherpaOnnxWave *wave, const std::string &dir,
+           const Manifest &manifest);
+
+bool save_manifest(const std::string &path, const Manifest &manifest);
+bool load_manifest(const std::string &path, Manifest &manifest);
+
+bool save_centroids(const std::string &path, const Centroids &centroids);
+bool load_centroids(const std::string &path, Centroids &centroids);
+
+// Stitch the shards' results, given in shard time, into one result in
+// source time. Segments are kept by the shard owning their midpoint and
+// speakers are relinked by centroid similarity above link_threshold, up to
+// max_speakers (<= 0 for unlimited). A shard with more speakers than that
+// has some merged, see embedding::link_speakers
+nlohmann::ordered_json merge(const Manifest &manifest,
+                             const std::vector<nlohmann::ordered_json> &results,
+                             const std::vector<Centroids> &centroids,
+                             float link_threshold, int32_t max_speakers);
+
+// Read the manifest at path and the results and centroids it lists, and
+// merge them
+bool merge_files(const std::string &path, float link_threshold,
+                 int32_t max_speakers, nlohmann::ordered_json &result);
+
+} // namespace shard
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace speakers {
+
+struct Match {
+  int32_t index = -1;
+  float score = 0.0f;
+};
+
+// Enrolled speaker embeddings stored row major and L2 normalized, so cosine
+// similarity is a plain dot product. An int8 copy with per row scales is kept
+// for scanning large rosters with a quarter of the memory bandwidth
+class SpeakerIndex {
+public:
+  bool load(const std::string &path);
+  bool save(const std::string &path) const;
+
+  // Add a speaker, or fold the embedding into an existing one. Returns false
+  // if its dimension doesn't match the index
+  bool enroll(const std::string &name, std::vector<float> embedding);
+
+  Match search(const std::vector<float> &query) const;
+  Match search_int8(const std::vector<float> &query) const;
+
+  const std::string &name(int32_t index) const { return names[index]; }
+  size_t size() const { return names.size(); }
+  int32_t dim() const { return dimension; }
+
+private:
+  void quantize_row(int32_t index);
+
+  int32_t dimension = 0;
+  std::vector<std::string> names;
+  std::unordered_map<std::string, int32_t> rows; // Name to its row
+  std::vector<uint32_t> counts;
+  std::vector<float> vectors;
+  std::vector<float> scales;
+  std::vector<int8_t> quantized;
+};
+
+// Match diarized speakers to enrolled names by their centroid
+std::map<int32_t, std::string>
+identify(const SpeakerIndex &index,
+         const std::map<int32_t, std::vector<float>> &centroids,
+         float threshold, bool use_int8);
+
+} // namespace speakers
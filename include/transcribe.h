@@ -1,12 +1,36 @@
 #pragma once
 
+#include "guard.h"
 #include <string>
 #include <whisper.h>
 
 namespace transcribe {
+// Whisper encodes 30 seconds into 1500 frames, 20ms each
+constexpr int samples_per_audio_ctx = 320;
+
+// Encoder context for a chunk: its length plus a safety margin, rounded up to
+// a few bucket sizes so whisper rebuilds its graph rarely. There are 11 of
+// them, 256 to 1408 in steps of 128 and the full 1500
+int audio_ctx_for_samples(int n_samples);
+
+// How much to trust a transcript, like whisper's own fallback checks
+struct Confidence {
+  float avg_logprob = 0.0f; // Mean log probability of the text tokens
+  // Length of the text over its LZ77 compressed size. Repetition loops
+  // compress well
+  float compression_ratio = 0.0f;
+  guard::Outcome stopped; // What the decode guard cut the text short on
+};
+
+// Length of text over a greedy LZ77 encoding of it
+float compression_ratio(const std::string &text);
+
+// Transcribe a chunk. confidence receives the scores of the transcript when
+// given
 std::string transcribe_audio_chunk(whisper_context *ctx,
                                    const whisper_full_params &params,
-                                   const float *samples, int n_samples);
+                                   const float *samples, int n_samples,
+                                   Confidence *confidence = nullptr);
 
 whisper_full_params create_whisper_params(std::string &language);
 } // namespace transcribe
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "guard.h"
+#include "mel.h"
+#include "transcribe.h"
+#include <memory>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+#include <whisper.h>
+
+namespace transcriber {
+
+// Per chunk knobs to trade accuracy for speed, backends ignore what they
+// can't honour
+struct ChunkOptions {
+  bool dynamic_audio_ctx = false;   // Encoder context sized to the chunk
+  bool temperature_fallback = true; // Retry failed decodes hotter
+  guard::Guard *guard = nullptr;    // Stops runaway decodes
+};
+
+// Audio of one chunk in a batch
+struct Samples {
+  const float *samples;
+  int n_samples;
+};
+
+// Speech to text of chunks of at most 30 seconds of 16kHz mono audio. A
+// transcriber isn't called from several threads at once
+class Transcriber {
+public:
+  virtual ~Transcriber() = default;
+
+  // confidence receives the scores of the transcript when given
+  virtual std::string transcribe(const float *samples, int n_samples,
+                                 const ChunkOptions &options,
+                                 transcribe::Confidence *confidence) = 0;
+  // Transcribe chunks in one call, confidences receives one per chunk when
+  // given. Backends that can't batch transcribe them one at a time
+  virtual std::vector<std::string>
+  transcribe_batch(const std::vector<Samples> &chunks,
+                   const ChunkOptions &options,
+                   std::vector<transcribe::Confidence> *confidences);
+  // Chunks worth passing to a transcribe_batch call
+  virtual int32_t batch_size() const { return 1; }
+  virtual const char *name() const = 0;
+
+  // Chunks passed until end_wave may point into these samples, so features
+  // of the whole audio can be computed once
+  virtual void begin_wave(const float *samples, int n_samples) {}
+  virtual void end_wave() {}
+};
+
+// whisper.cpp. With shared_mel, chunks of the wave given to begin_wave get
+// slices of one log mel spectrogram of it instead of whisper computing one
+// per chunk
+class WhisperTranscriber : public Transcriber {
+public:
+  // Returns nullptr if the model fails to load
+  static std::unique_ptr<WhisperTranscriber>
+  create(const std::string &model_path, const std::string &language,
+         bool shared_mel = false);
+  ~WhisperTranscriber() override;
+
+  WhisperTranscriber(const WhisperTranscriber &) = delete;
+  WhisperTranscriber &operator=(const WhisperTranscriber &) = delete;
+
+  std::string transcribe(const float *samples, int n_samples,
+                         const ChunkOptions &options,
+                         transcribe::Confidence *confidence) override;
+  const char *name() const override { return "whisper"; }
+  void begin_wave(const float *samples, int n_samples) override;
+  void end_wave() override;
+
+private:
+  WhisperTranscriber(whisper_context *ctx, const std::string &language,
+                     bool shared_mel);
+
+  whisper_context *ctx;
+  std::string language; // Params point into it
+  whisper_full_params params;
+
+  bool shared_mel;
+  std::vector<float> mel_filters; // Of the model, empty for Slaney's
+  const float *wave_samples = nullptr;
+  int wave_size = 0;
+  std::unique_ptr<mel::Spectrogram> spectrogram; // Of the wave, lazily
+  std::vector<float> mel_slice;
+};
+
+struct SherpaConfig {
+  // Directory of a sherpa-onnx offline model and its tokens.txt
+  std::string model_dir;
+  std::string model_type = "sense_voice"; // Or paraformer, moonshine, whisper
+  std::string language;                   // Empty or auto detects it
+  std::string provider = "cpu";
+  int32_t num_threads = 4;
+  int32_t batch_size = 16;
+};
+
+// Sherpa-onnx's offline recognizers. They take audio of any length, so
+// chunks aren't padded, and decode a batch of chunks in one call. They
+// don't report token probabilities, avg_logprob is always 0
+class SherpaTranscriber : public Transcriber {
+public:
+  // Returns nullptr if the model fails to load
+  static std::unique_ptr<SherpaTranscriber> create(const SherpaConfig &config);
+  ~SherpaTranscriber() override;
+
+  SherpaTranscriber(const SherpaTranscriber &) = delete;
+  SherpaTranscriber &operator=(const SherpaTranscriber &) = delete;
+
+  std::string transcribe(const float *samples, int n_samples,
+                         const ChunkOptions &options,
+                         transcribe::Confidence *confidence) override;
+  std::vector<std::string>
+  transcribe_batch(const std::vector<Samples> &chunks,
+                   const ChunkOptions &options,
+                   std::vector<transcribe::Confidence> *confidences) override;
+  int32_t batch_size() const override { return batch; }
+  const char *name() const override { return "sherpa"; }
+
+private:
+  SherpaTranscriber(const SherpaOnnxOfflineRecognizer *recognizer,
+                    int32_t batch);
+
+  const SherpaOnnxOfflineRecognizer *recognizer;
+  int32_t batch;
+};
+
+// Latency of a mock backend: a fixed cost per call plus a real time factor
+struct MockConfig {
+  double latency = 0.0; // Seconds per call
+  double rtf = 0.0;     // Seconds per second of audio
+};
+
+// Sleeps like a model and returns words picked by a hash of the audio, so
+// the same audio always gives the same text
+class MockTranscriber : public Transcriber {
+public:
+  explicit MockTranscriber(MockConfig config) : config(config) {}
+
+  std::string transcribe(const float *samples, int n_samples,
+                         const ChunkOptions &options,
+                         transcribe::Confidence *confidence) override;
+  const char *name() const override { return "mock"; }
+
+private:
+  MockConfig config;
+};
+
+// Sleep for the modelled latency of a call over audio_seconds
+void mock_sleep(const MockConfig &config, double audio_seconds);
+
+} // namespace transcriber
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Columnar binary transcripts. Start, end, speaker and speaker name index are
+// columns, text lives in a string heap, and the segments sorted by start
+// with the running maximum of their ends and a max tree of their ends form
+// the time index. Files are little endian and read in place through mmap,
+// opening one doesn't depend on its size
+namespace transcript {
+
+struct Header;
+
+struct Segment {
+  float start;
+  float end;
+  int32_t speaker;
+  std::string_view speaker_name; // Empty when the speaker isn't named
+  std::string_view text;
+  // Other fields of the JSON segment (eg. degraded), as compact JSON
+  std::string_view extra;
+};
+
+// Write the segments of a JSON result. Returns false if a segment lacks
+// start, end, speaker or text, or has them of the wrong type
+bool save(const std::string &path, const nlohmann::ordered_json &result);
+
+// Memory mapped transcript. Segments and the views into them stay valid
+// until the reader is closed or destroyed
+class Reader {
+public:
+  Reader() = default;
+  ~Reader();
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+
+  uint32_t size() const;
+  Segment segment(uint32_t index) const;
+
+  // Indices of the segments spoken at seconds, in start order. Binary
+  // searches over the time index bound the segments that may reach seconds,
+  // and a max tree of their ends skips the ones that ended before it, so a
+  // lookup is logarithmic however long single segments are
+  std::vector<uint32_t> at(float seconds) const;
+
+  // The JSON result the transcript was saved from
+  nlohmann::ordered_json to_json() const;
+
+private:
+  std::string_view heap_string(const uint32_t *offsets, uint32_t index) const;
+  void collect(uint32_t node, uint32_t node_begin, uint32_t node_end,
+               uint32_t begin, uint32_t end, float seconds,
+               std::vector<uint32_t> &found) const;
+
+  const char *data = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void *file = nullptr;
+  void *mapping = nullptr;
+#endif
+
+  const Header *header = nullptr;
+  const float *starts = nullptr;
+  const float *ends = nullptr;
+  const int32_t *speakers = nullptr;
+  const int32_t *names = nullptr; // Into name_offsets, -1 for none
+  const uint32_t *text_offsets = nullptr;
+  const uint32_t *extra_offsets = nullptr;
+  const uint32_t *order = nullptr; // Segments by start
+  const float *max_ends = nullptr; // Running maximum of ends along order
+  const uint32_t *name_offsets = nullptr;
+  const char *heap = nullptr;
+
+  // Implicit binary tree of the maximum end over ranges of start order.
+  // Leaves start at tree_leaves
+  const float *end_tree = nullptr;
+  uint32_t tree_leaves = 0;
+};
+
+} // namespace transcript
@@ -52,4 +52,22 @@ void set_executable(const std::string &file_path);
 bool check_program_installed(const std::string &program_path, int argc,
                              char *argv[]);
 void log_version();
+
+// Exclusive lock on <path>.lock for the lifetime of the object, so processes
+// sharing a file don't interleave their read-modify-write
+class FileLock {
+public:
+  explicit FileLock(const std::string &path);
+  ~FileLock();
+
+  FileLock(const FileLock &) = delete;
+  FileLock &operator=(const FileLock &) = delete;
+
+  bool locked() const { return is_locked; }
+
+private:
+  void *handle = nullptr; // HANDLE on Windows
+  int fd = -1;
+  bool is_locked = false;
+};
 } // namespace utils
\ No newline at end of file
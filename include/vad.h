@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <sherpa-onnx/c-api/c-api.h>
+#include <string>
+#include <vector>
+
+namespace vad {
+
+struct VadConfig {
+  std::string model_path;
+  std::string provider;
+  int32_t onnx_num_threads = 1;
+  float threshold = 0.5f;
+  float min_silence_duration = 0.5f;
+  float min_speech_duration = 0.25f;
+  float padding = 0.2f; // Seconds of context kept around each speech region
+};
+
+// Speech region copied into the compacted buffer (in samples)
+struct Region {
+  int32_t compact_start;
+  int32_t original_start;
+  int32_t length;
+};
+
+// Speech-only audio with a map back to the original timeline
+struct CompactAudio {
+  std::vector<float> samples;
+  std::vector<Region> regions;
+  SherpaOnnxWave wave; // View over samples, don't free with sherpa
+  int32_t original_num_samples = 0;
+
+  // Map seconds in the compacted audio back to the original file. End
+  // timestamps that fall on a region boundary stay in the earlier region
+  float to_original(float seconds, bool is_end) const;
+  float skipped_fraction() const;
+};
+
+std::unique_ptr<CompactAudio> compact_speech(const SherpaOnnxWave *wave,
+                                             const VadConfig &config);
+
+} // namespace vad
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Pin the SHA-256 of every built-in download in src/config.cpp.
+
+Each `<name>_url` is downloaded and the `<name>_sha256` that follows it is
+set to its digest. With --check nothing is written, and the script fails if
+a pinned digest doesn't match what the URL serves. A missing digest is only
+reported, loud downloads that resource unverified. --strict fails on it too.
+
+    python3 scripts/pin_digests.py
+    python3 scripts/pin_digests.py --check
+    python3 scripts/pin_digests.py --check --strict
+"""
+
+import argparse
+import hashlib
+import re
+import sys
+import urllib.request
+from pathlib import Path
+
+CONFIG = Path(__file__).resolve().parent.parent / "src" / "config.cpp"
+
+URL_RE = re.compile(r'std::string (\w+)_url =((?:\s*"[^"]*")+);')
+SHA_RE = re.compile(r'(std::string (\w+)_sha256 =)\s*"([0-9a-f]*)";')
+
+
+def digest(url):
+    hasher = hashlib.sha256()
+    with urllib.request.urlopen(url) as response:
+        while chunk := response.read(1 << 20):
+            hasher.update(chunk)
+    return hasher.hexdigest()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--check", action="store_true",
+                        help="Fail on stale digests, don't write")
+    parser.add_argument("--strict", action="store_true",
+                        help="With --check, fail on missing digests too")
+    args = parser.parse_args()
+
+    source = CONFIG.read_text()
+    pinned = source
+    failed = False
+    # Walk backwards so replacing a digest keeps earlier offsets valid
+    for match in reversed(list(URL_RE.finditer(source))):
+        name = match.group(1)
+        url = "".join(re.findall(r'"([^"]*)"', match.group(2)))
+        sha = SHA_RE.search(source, match.end())
+        if not sha or sha.group(2) != name:
+            print(f"✗ {name}_url has no {name}_sha256 after it")
+            failed = True
+            continue
+        actual = digest(url)
+        if sha.group(3) == actual:
+            print(f"✓ {name} {url} {actual}")
+            continue
+        if args.check and not sha.group(3):
+            print(f"! {name} {url} is {actual}, nothing pinned")
+            failed = failed or args.strict
+            continue
+        if args.check:
+            print(f"✗ {name} {url} is {actual}, expected {sha.group(3)}")
+            failed = True
+            continue
+        print(f"✓ {name} {url} pinned to {actual}")
+        # A digest doesn't fit next to its name in 80 columns
+        pinned = (pinned[:sha.start()] + f'{sha.group(1)}\n    "{actual}";' +
+                  pinned[sha.end():])
+
+    if not args.check and pinned != source:
+        CONFIG.write_text(pinned)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
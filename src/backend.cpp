@@ -0,0 +1,151 @@
+#include "backend.h"
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <whisper.h>
+
+#ifdef LOUD_CPU_DISPATCH
+#include <ggml-backend.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+namespace backend {
+
+#ifdef LOUD_CPU_DISPATCH
+
+// Same names ggml searches for when picking the best variant
+#ifdef _WIN32
+static const std::string variant_prefix = "ggml-cpu-";
+static const std::string variant_suffix = ".dll";
+#else
+static const std::string variant_prefix = "libggml-cpu-";
+static const std::string variant_suffix = ".so";
+#endif
+
+// ggml looks for backends next to the executable, not next to libloud
+static fs::path executable_dir() {
+#ifdef _WIN32
+  std::wstring path(MAX_PATH, L'\0');
+  DWORD size = GetModuleFileNameW(nullptr, path.data(),
+                                  static_cast<DWORD>(path.size()));
+  path.resize(size);
+  return fs::path(path).parent_path();
+#elif defined(__APPLE__)
+  uint32_t size = 0;
+  _NSGetExecutablePath(nullptr, &size);
+  std::string path(size, '\0');
+  if (_NSGetExecutablePath(path.data(), &size) != 0) {
+    return fs::current_path();
+  }
+  return fs::canonical(path.c_str()).parent_path();
+#else
+  std::error_code ec;
+  auto path = fs::read_symlink("/proc/self/exe", ec);
+  if (ec) {
+    return fs::current_path();
+  }
+  return path.parent_path();
+#endif
+}
+
+std::vector<std::string> cpu_variants() {
+  std::vector<std::string> variants;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(executable_dir(), ec)) {
+    auto name = entry.path().filename().string();
+    if (name.size() > variant_prefix.size() + variant_suffix.size() &&
+        name.compare(0, variant_prefix.size(), variant_prefix) == 0 &&
+        name.compare(name.size() - variant_suffix.size(),
+                     variant_suffix.size(), variant_suffix) == 0) {
+      variants.push_back(name.substr(variant_prefix.size(),
+                                     name.size() - variant_prefix.size() -
+                                         variant_suffix.size()));
+    }
+  }
+  std::sort(variants.begin(), variants.end());
+  return variants;
+}
+
+bool load_cpu_variant(const std::string &variant) {
+  // Backends stay registered for the whole process, load each one once
+  static std::mutex mutex;
+  static std::string loaded;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (variant.empty() || variant == loaded) {
+    return true;
+  }
+  // ggml would keep using the first one
+  if (!loaded.empty()) {
+    SPDLOG_ERROR("CPU variant {} is already loaded, can't switch to {}",
+                 loaded, variant);
+    return false;
+  }
+  auto path = executable_dir() / (variant_prefix + variant + variant_suffix);
+  if (!fs::exists(path)) {
+    std::string available;
+    for (const auto &name : cpu_variants()) {
+      available += (available.empty() ? "" : ", ") + name;
+    }
+    SPDLOG_ERROR("CPU variant {} not found at {} (available: {})", variant,
+                 path.string(), available);
+    return false;
+  }
+  // Fails when cpuid doesn't support the variant
+  if (!ggml_backend_load(path.string().c_str())) {
+    SPDLOG_ERROR("CPU variant {} isn't supported on this machine", variant);
+    return false;
+  }
+  loaded = variant;
+  return true;
+}
+
+void log_cpu_backend() {
+  auto *device = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+  if (!device) {
+    SPDLOG_WARN("No CPU backend loaded");
+    return;
+  }
+  auto *reg = ggml_backend_dev_backend_reg(device);
+  auto get_features = reinterpret_cast<ggml_backend_get_features_t>(
+      ggml_backend_reg_get_proc_address(reg, "ggml_backend_get_features"));
+  std::string features;
+  if (get_features) {
+    for (auto *feature = get_features(reg); feature && feature->name;
+         feature++) {
+      if (std::string(feature->value) == "1") {
+        features += (features.empty() ? "" : " ") + std::string(feature->name);
+      }
+    }
+  }
+  SPDLOG_INFO("CPU backend: {} ({})", ggml_backend_dev_description(device),
+              features.empty() ? "no features" : features);
+}
+
+#else
+
+std::vector<std::string> cpu_variants() { return {}; }
+
+bool load_cpu_variant(const std::string &variant) {
+  if (variant.empty()) {
+    return true;
+  }
+  SPDLOG_ERROR("Selecting a CPU variant requires a build with "
+               "LOUD_CPU_DISPATCH=ON");
+  return false;
+}
+
+void log_cpu_backend() {
+  SPDLOG_DEBUG("CPU backend: {}", whisper_print_system_info());
+}
+
+#endif
+
+} // namespace backend
@@ -0,0 +1,249 @@
+#include "channels.h"
+#include "ffmpeg.h"
+#include "spdlog/spdlog.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace channels {
+
+static uint16_t read_u16(const char *data) {
+  return static_cast<uint16_t>(static_cast<uint8_t>(data[0]) |
+                               static_cast<uint8_t>(data[1]) << 8);
+}
+
+static uint32_t read_u32(const char *data) {
+  return static_cast<uint32_t>(read_u16(data)) |
+         static_cast<uint32_t>(read_u16(data + 2)) << 16;
+}
+
+std::unique_ptr<MultiChannelAudio> read_wav(const std::string &path,
+                                            float start, float end) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return nullptr;
+  }
+  char header[12];
+  if (!file.read(header, sizeof(header)) ||
+      std::memcmp(header, "RIFF", 4) != 0 ||
+      std::memcmp(header + 8, "WAVE", 4) != 0) {
+    return nullptr;
+  }
+
+  uint16_t format = 0;
+  uint16_t num_channels = 0;
+  uint32_t sample_rate = 0;
+  uint16_t bits_per_sample = 0;
+  char chunk[8];
+  while (file.read(chunk, sizeof(chunk))) {
+    uint32_t size = read_u32(chunk + 4);
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      std::vector<char> fmt(size);
+      if (size < 16 || !file.read(fmt.data(), size)) {
+        return nullptr;
+      }
+      format = read_u16(fmt.data());
+      num_channels = read_u16(fmt.data() + 2);
+      sample_rate = read_u32(fmt.data() + 4);
+      bits_per_sample = read_u16(fmt.data() + 14);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub format
+      if (format == 0xFFFE && size >= 26) {
+        format = read_u16(fmt.data() + 24);
+      }
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      break;
+    } else {
+      // Chunks are word aligned
+      file.seekg(size + (size & 1), std::ios::cur);
+    }
+  }
+  if (!file || num_channels == 0) {
+    return nullptr;
+  }
+
+  bool is_pcm16 = format == 1 && bits_per_sample == 16;
+  bool is_float = format == 3 && bits_per_sample == 32;
+  if (!is_pcm16 && !is_float) {
+    SPDLOG_ERROR("Unsupported wav format {} ({} bits) in {}", format,
+                 bits_per_sample, path);
+    return nullptr;
+  }
+
+  size_t frame_size = num_channels * (bits_per_sample / 8);
+  size_t data_size = read_u32(chunk + 4);
+  // Seek to the first frame of the range instead of reading up to it
+  auto first_frame =
+      static_cast<size_t>(std::max(0.0f, start) * sample_rate + 0.5f);
+  first_frame = std::min(first_frame, data_size / frame_size);
+  data_size -= first_frame * frame_size;
+  if (end > 0.0f) {
+    auto last_frame = static_cast<size_t>(end * sample_rate + 0.5f);
+    size_t range_frames = last_frame > first_frame ? last_frame - first_frame
+                                                   : 0;
+    data_size = std::min(data_size, range_frames * frame_size);
+  }
+  file.seekg(static_cast<std::streamoff>(first_frame * frame_size),
+             std::ios::cur);
+  std::vector<char> data(data_size);
+  file.read(data.data(), data_size);
+  data.resize(static_cast<size_t>(file.gcount()));
+
+  auto audio = std::make_unique<MultiChannelAudio>();
+  audio->sample_rate = static_cast<int32_t>(sample_rate);
+  audio->offset = static_cast<float>(first_frame) / sample_rate;
+  size_t num_frames = data.size() / frame_size;
+  audio->channels.assign(num_channels, std::vector<float>(num_frames));
+  for (size_t i = 0; i < num_frames; i++) {
+    const char *frame = data.data() + i * frame_size;
+    for (uint16_t c = 0; c < num_channels; c++) {
+      if (is_pcm16) {
+        auto value = static_cast<int16_t>(read_u16(frame + c * 2));
+        audio->channels[c][i] = value / 32768.0f;
+      } else {
+        float value;
+        std::memcpy(&value, frame + c * 4, sizeof(value));
+        audio->channels[c][i] = value;
+      }
+    }
+  }
+  return audio;
+}
+
+std::unique_ptr<MultiChannelAudio>
+prepare_audio_file(const std::string &audio_file, int argc, char *argv[],
+                   float start, float end) {
+  std::unique_ptr<MultiChannelAudio> audio;
+  if (fs::path(audio_file).extension() == ".wav") {
+    audio = read_wav(audio_file, start, end);
+  }
+  if (!audio || audio->sample_rate != 16000) {
+    if (!utils::is_program_installed("ffmpeg")) {
+      ffmpeg::show_ffmpeg_normalize_suggestion(audio_file, argc, argv);
+      return nullptr;
+    }
+    auto random_path = utils::get_random_path(".wav");
+    ffmpeg::normalize_audio(audio_file, random_path, true, start, end);
+    audio = read_wav(random_path);
+    fs::remove(random_path);
+    if (audio) {
+      audio->offset = start;
+    }
+  }
+  if (!audio || audio->sample_rate != 16000) {
+    std::cerr << "Error: Failed to read " << audio_file << " as 16,000 Hz audio"
+              << std::endl;
+    return nullptr;
+  }
+  if ((start > 0.0f || end > 0.0f) && audio->num_samples() == 0) {
+    std::cerr << "Error: No audio in the requested range of " << audio_file
+              << std::endl;
+    return nullptr;
+  }
+  if (audio->channels.size() < 2) {
+    SPDLOG_WARN("{} has a single channel, all speech is speaker 0",
+                audio_file);
+  }
+  return audio;
+}
+
+// Frame energies in dBFS
+static std::vector<float> frame_energies(const std::vector<float> &samples,
+                                         size_t frame_size) {
+  std::vector<float> energies(samples.size() / frame_size);
+  for (size_t f = 0; f < energies.size(); f++) {
+    const float *frame = samples.data() + f * frame_size;
+    double sum = 0.0;
+    for (size_t i = 0; i < frame_size; i++) {
+      sum += frame[i] * frame[i];
+    }
+    energies[f] =
+        static_cast<float>(10.0 * std::log10(sum / frame_size + 1e-10));
+  }
+  return energies;
+}
+
+std::vector<diarization::DiarizationSegment>
+speech_turns(const MultiChannelAudio &audio, const EnergyConfig &config) {
+  size_t frame_size =
+      std::max<size_t>(1, static_cast<size_t>(config.frame_seconds * 16000));
+  std::vector<std::vector<float>> energies;
+  for (const auto &samples : audio.channels) {
+    energies.push_back(frame_energies(samples, frame_size));
+  }
+  size_t num_frames = energies.empty() ? 0 : energies[0].size();
+
+  // Loudest channel per frame, to tell speech from bleed of the other side
+  std::vector<float> loudest(num_frames, -100.0f);
+  for (const auto &channel : energies) {
+    for (size_t f = 0; f < num_frames; f++) {
+      loudest[f] = std::max(loudest[f], channel[f]);
+    }
+  }
+
+  auto frames = [&](float seconds) {
+    return static_cast<size_t>(seconds * 16000 / frame_size);
+  };
+  size_t min_silence = frames(config.min_silence_duration);
+  size_t min_speech = frames(config.min_speech_duration);
+  size_t padding = frames(config.padding);
+  float frame_seconds = static_cast<float>(frame_size) / 16000;
+
+  std::vector<diarization::DiarizationSegment> turns;
+  for (size_t c = 0; c < energies.size(); c++) {
+    const auto &channel = energies[c];
+    if (channel.empty()) {
+      continue;
+    }
+    // Noise floor is the 10th percentile of the frame energies
+    auto sorted = channel;
+    auto nth = sorted.begin() + sorted.size() / 10;
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    float threshold = std::max(config.floor_db, *nth + config.margin_db);
+
+    // Runs of speech frames, bridging short pauses
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t f = 0; f < num_frames; f++) {
+      bool speech = channel[f] >= threshold &&
+                    channel[f] >= loudest[f] - config.crosstalk_db;
+      if (!speech) {
+        continue;
+      }
+      if (!runs.empty() && f - runs.back().second <= min_silence) {
+        runs.back().second = f + 1;
+      } else {
+        runs.push_back({f, f + 1});
+      }
+    }
+
+    size_t added = 0;
+    for (const auto &[start, end] : runs) {
+      if (end - start < min_speech) {
+        continue;
+      }
+      size_t padded_start = start > padding ? start - padding : 0;
+      size_t padded_end = std::min(num_frames, end + padding);
+      // Padding can make neighbours touch
+      if (added > 0 && padded_start * frame_seconds <= turns.back().end) {
+        turns.back().end = padded_end * frame_seconds;
+        continue;
+      }
+      turns.push_back({padded_start * frame_seconds,
+                       padded_end * frame_seconds, static_cast<int32_t>(c)});
+      added++;
+    }
+    SPDLOG_DEBUG("channel {} has {} turns (threshold {:.1f} dBFS)", c, added,
+                 threshold);
+  }
+
+  std::sort(turns.begin(), turns.end(),
+            [](const auto &a, const auto &b) { return a.start < b.start; });
+  return turns;
+}
+
+} // namespace channels
@@ -1,41 +1,55 @@
 #include <string>
 
 namespace config {
+// SHA-256 checksums are verified after download. Pin them with
+// scripts/pin_digests.py, resources without one are downloaded unverified
 std::string ggml_tiny_url =
     "https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-tiny.bin";
 std::string ggml_tiny_name = "ggml-tiny.bin";
+std::string ggml_tiny_sha256 = "";
 
 std::string segmentation_url =
     "https://github.com/thewh1teagle/loud.cpp/releases/download/v0.1.0/"
     "pyannote-segmentation-3-0.onnx";
 std::string segmentation_name = "pyannote-segmentation-3-0.onnx";
+std::string segmentation_sha256 = "";
 
 std::string embedding_url = "https://github.com/thewh1teagle/loud.cpp/releases/"
                             "download/v0.1.0/nemo_en_titanet_small.onnx";
 std::string embedding_name = "nemo_en_titanet_small.onnx";
+std::string embedding_sha256 = "";
+
+std::string vad_url = "https://github.com/k2-fsa/sherpa-onnx/releases/download/"
+                      "asr-models/silero_vad.onnx";
+std::string vad_name = "silero_vad.onnx";
+std::string vad_sha256 = "";
 
 #ifdef _WIN32
 std::string ffmpeg_name = "ffmpeg.exe";
 std::string ffmpeg_url =
     "https://github.com/shaka-project/static-ffmpeg-binaries/releases/download/"
     "n7.1-1/ffmpeg-win-x64.exe";
+std::string ffmpeg_sha256 = "";
 #elif defined(__APPLE__)
 #if defined(__aarch64__) || defined(__arm64__)
 std::string ffmpeg_name = "ffmpeg";
 std::string ffmpeg_url =
     "https://github.com/shaka-project/static-ffmpeg-binaries/releases/download/"
     "n7.1-1/ffmpeg-osx-arm64";
+std::string ffmpeg_sha256 = "";
 #else
 std::string ffmpeg_name = "ffmpeg";
 std::string ffmpeg_url =
     "https://github.com/shaka-project/static-ffmpeg-binaries/releases/download/"
     "n7.1-1/ffmpeg-osx-x64";
+std::string ffmpeg_sha256 = "";
 #endif
 #elif defined(__linux__)
 std::string ffmpeg_name = "ffmpeg";
 std::string ffmpeg_url =
     "https://github.com/shaka-project/static-ffmpeg-binaries/releases/download/"
     "n7.1-1/ffmpeg-linux-x64";
+std::string ffmpeg_sha256 = "";
 #else
 #error "Unsupported OS for FFmpeg download."
 #endif
@@ -0,0 +1,85 @@
+#include "deadline.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+
+namespace deadline {
+
+// Chunks measured at a level before it's judged, one is too noisy
+static constexpr int32_t min_chunks_at_level = 2;
+// Weight of the newest chunk in the cost estimate
+static constexpr double cost_smoothing = 0.3;
+// Step back up only when the projection uses less than this of the time left
+static constexpr double headroom = 0.5;
+
+const char *step_name(Step step) {
+  switch (step) {
+  case Step::no_fallback:
+    return "no_fallback";
+  case Step::reduced_audio_ctx:
+    return "reduced_audio_ctx";
+  case Step::fallback_model:
+    return "fallback_model";
+  }
+  return "unknown";
+}
+
+Controller::Controller(double budget_seconds, Clock::time_point start,
+                       std::vector<Step> steps)
+    : budget(budget_seconds), start(start), steps(std::move(steps)),
+      level_costs(this->steps.size() + 1, 0.0) {}
+
+bool Controller::applies(Step step) const {
+  auto end = steps.begin() + current;
+  return std::find(steps.begin(), end, step) != end;
+}
+
+std::vector<std::string> Controller::active_steps() const {
+  std::vector<std::string> names;
+  for (int32_t i = 0; i < current; i++) {
+    names.push_back(step_name(steps[i]));
+  }
+  return names;
+}
+
+void Controller::update(double audio_seconds, double elapsed,
+                        double remaining_audio) {
+  if (audio_seconds <= 0.0) {
+    return;
+  }
+  double sample = elapsed / audio_seconds;
+  cost = measured ? cost + cost_smoothing * (sample - cost) : sample;
+  measured = true;
+  if (++chunks_at_level < min_chunks_at_level) {
+    return;
+  }
+
+  double left =
+      budget -
+      std::chrono::duration<double>(Clock::now() - start).count();
+  double projected = remaining_audio * cost;
+  level_costs[current] = cost;
+  // Going back up is judged by what the better level cost when it ran
+  double projected_above =
+      current > 0 ? remaining_audio * level_costs[current - 1] : 0.0;
+  if (projected > left && current < static_cast<int32_t>(steps.size())) {
+    change_level(current + 1, projected, left);
+  } else if (current > 0 && projected_above < headroom * left) {
+    change_level(current - 1, projected_above, left);
+  }
+}
+
+void Controller::change_level(int32_t level, double projected, double left) {
+  bool down = level > current;
+  Step step = steps[down ? current : level];
+  SPDLOG_INFO("{} deadline, {:.1f}s of work projected for {:.1f}s left: {} "
+              "{}",
+              down ? "Behind" : "Ahead of", projected, std::max(left, 0.0),
+              down ? "taking" : "dropping", step_name(step));
+  current = level;
+  // The cost at the new level is measured from scratch
+  measured = false;
+  chunks_at_level = 0;
+  num_decisions++;
+}
+
+} // namespace deadline
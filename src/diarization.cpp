@@ -2,11 +2,16 @@
 #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
 
 #include "diarization.h"
+#include "channels.h"
+#include "embedding.h"
 #include "ffmpeg.h"
 #include "sherpa-onnx/c-api/c-api.h"
 #include "spdlog/spdlog.h"
-#include "spinner.h"
+#include "progress.h"
 #include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -18,11 +23,11 @@
 #include <string>
 #include <subprocess.hpp>
 #include <termcolor/termcolor.hpp>
+#include <thread>
 #include <vector>
 #include <whisper.h>
 
 namespace fs = std::filesystem;
-using spinner::Spinner;
 
 namespace diarization {
 
@@ -39,22 +44,8 @@ std::map<int, std::ostream &(*)(std::ostream &)> speaker_colors;
 
 int32_t diarization_progress_callback(int32_t num_processed_chunk,
                                       int32_t num_total_chunks,
-                                      Spinner *spinner) {
-
-  CHECK_NULL(spinner);
-  float progress =
-      (static_cast<float>(num_processed_chunk) / num_total_chunks) * 100.0f;
-
-  spinner->updateMessage("Diarization... " +
-                         std::to_string(static_cast<int>(progress)) + "%");
-
-  // Stop the spinner if progress is complete
-  if (progress >= 100.0f) {
-    spinner->stop();
-    std::cout << termcolor::green << "✓" << termcolor::reset
-              << " Diarization complete!" << std::endl;
-  }
-
+                                      progress::Stage *stage) {
+  stage->update(num_processed_chunk, num_total_chunks);
   return 0;
 }
 
@@ -82,6 +73,7 @@ void print_segment(const DiarizationSegment &segment, const std::string &text) {
 
   // Get the color for the current speaker
   auto color = speaker_colors[segment.speaker];
+  auto lock = progress::pause();
 
   // Print the segment with the appropriate color
   std::cout << std::fixed << std::setprecision(0)
@@ -130,25 +122,69 @@ const SherpaOnnxWave *read_wave(const std::string &path) {
   return wave;
 }
 
-const SherpaOnnxWave *prepare_audio_file(const std::string &audio_file,
-                                         int argc, char *argv[]) {
+Audio::Audio(const SherpaOnnxWave *wave) : sherpa(wave) {}
 
-  const SherpaOnnxWave *wave = nullptr;
+Audio::Audio(std::vector<float> samples, float offset)
+    : offset(offset), samples(std::move(samples)) {
+  view.samples = this->samples.data();
+  view.sample_rate = 16000;
+  view.num_samples = static_cast<int32_t>(this->samples.size());
+}
+
+Audio::~Audio() {
+  if (sherpa) {
+    SherpaOnnxFreeWave(sherpa);
+  }
+}
+
+// Downmix a range of a 16kHz wav file, read without decoding the rest
+static std::unique_ptr<Audio> read_wave_range(const std::string &path,
+                                              float start, float end) {
+  auto audio = channels::read_wav(path, start, end);
+  if (!audio || audio->sample_rate != 16000) {
+    return nullptr;
+  }
+  std::vector<float> samples(audio->num_samples());
+  for (const auto &channel : audio->channels) {
+    for (size_t i = 0; i < samples.size(); i++) {
+      samples[i] += channel[i] / audio->channels.size();
+    }
+  }
+  return std::make_unique<Audio>(std::move(samples), audio->offset);
+}
+
+std::unique_ptr<Audio> prepare_audio_file(const std::string &audio_file,
+                                          int argc, char *argv[], float start,
+                                          float end) {
+
+  std::unique_ptr<Audio> audio;
+  bool is_range = start > 0.0f || end > 0.0f;
   auto is_wav = fs::path(audio_file).extension() == ".wav";
   if (is_wav) {
-    wave = diarization::read_wave(audio_file);
+    if (is_range) {
+      audio = read_wave_range(audio_file, start, end);
+    } else if (auto *wave = diarization::read_wave(audio_file)) {
+      audio = std::make_unique<Audio>(wave);
+    }
   }
-  if (wave == nullptr) {
+  if (audio == nullptr) {
     if (utils::is_program_installed("ffmpeg")) {
       auto random_path = utils::get_random_path(".wav");
-      ffmpeg::normalize_audio(audio_file, random_path);
-      wave = diarization::read_wave(random_path);
+      ffmpeg::normalize_audio(audio_file, random_path, false, start, end);
+      auto *wave = diarization::read_wave(random_path);
+      if (wave == nullptr) {
+        std::cerr << "Error: Failed to convert " << audio_file << std::endl;
+        return nullptr;
+      }
+      audio = std::make_unique<Audio>(wave);
+      audio->offset = start;
     } else {
       ffmpeg::show_ffmpeg_normalize_suggestion(audio_file, argc, argv);
       return nullptr;
     }
   }
 
+  const auto *wave = audio->wave();
   if (wave->sample_rate != 16000) {
     std::cerr
         << "Error: The audio file must have a sample rate of 16,000 Hz. Found "
@@ -156,8 +192,13 @@ const SherpaOnnxWave *prepare_audio_file(const std::string &audio_file,
     ffmpeg::show_ffmpeg_normalize_suggestion(audio_file, argc, argv);
     return nullptr;
   }
+  if (is_range && wave->num_samples == 0) {
+    std::cerr << "Error: No audio in the requested range of " << audio_file
+              << std::endl;
+    return nullptr;
+  }
 
-  return wave;
+  return audio;
 }
 
 void to_json(nlohmann::json &j, const DiarizationSegment &segment) {
@@ -191,6 +232,9 @@ std::string generate_cache_key(int argc, char *argv[]) {
 void save_diarization_to_cache(
     const std::string &cache_key,
     const std::vector<DiarizationSegment> &segments) {
+  if (cache_key.empty()) {
+    return;
+  }
   std::filesystem::path temp_dir =
       std::filesystem::temp_directory_path() / "diarization_cache";
   std::filesystem::create_directories(temp_dir);
@@ -208,6 +252,9 @@ void save_diarization_to_cache(
 
 std::vector<DiarizationSegment>
 load_diarization_from_cache(const std::string &cache_key) {
+  if (cache_key.empty()) {
+    return {};
+  }
   std::filesystem::path temp_dir =
       std::filesystem::temp_directory_path() / "diarization_cache";
   std::filesystem::path cache_file = temp_dir / (cache_key + ".json");
@@ -227,12 +274,38 @@ load_diarization_from_cache(const std::string &cache_key) {
   return json_segments.get<std::vector<DiarizationSegment>>();
 }
 
+struct DiarizationWindow {
+  int32_t start_sample = 0;
+  int32_t end_sample = 0;
+  std::vector<DiarizationSegment> segments;
+  std::map<int32_t, std::vector<float>> centroids;
+};
+
+static std::vector<DiarizationSegment>
+collect_segments(const SherpaOnnxOfflineSpeakerDiarizationResult *result) {
+  std::vector<DiarizationSegment> diarization_segments;
+  const auto num_segments =
+      SherpaOnnxOfflineSpeakerDiarizationResultGetNumSegments(result);
+  const auto *segments =
+      SherpaOnnxOfflineSpeakerDiarizationResultSortByStartTime(result);
+
+  for (int32_t i = 0; i < num_segments; ++i) {
+    DiarizationSegment segment;
+    segment.start = segments[i].start;
+    segment.end = segments[i].end;
+    segment.speaker = segments[i].speaker;
+    diarization_segments.push_back(segment);
+  }
+
+  SherpaOnnxOfflineSpeakerDiarizationDestroySegment(segments);
+  SherpaOnnxOfflineSpeakerDiarizationDestroyResult(result);
+  return diarization_segments;
+}
+
 const std::vector<DiarizationSegment>
-run_diarization(int argc, char *argv[],
+run_diarization(const std::string &cache_key,
                 const SherpaOnnxOfflineSpeakerDiarization *sd,
-                const SherpaOnnxWave *wave, Spinner &spinner) {
-
-  std::string cache_key = generate_cache_key(argc, argv);
+                const SherpaOnnxWave *wave, progress::Stage &stage) {
 
   std::vector<DiarizationSegment> diarization_segments =
       load_diarization_from_cache(cache_key);
@@ -247,30 +320,195 @@ run_diarization(int argc, char *argv[],
              void *arg) -> int32_t {
             return diarization::diarization_progress_callback(
                 num_processed_chunk, num_total_chunks,
-                static_cast<Spinner *>(arg));
+                static_cast<progress::Stage *>(arg));
           },
-          &spinner);
+          &stage);
 
-  spinner.stop();
-  const auto num_segments =
-      SherpaOnnxOfflineSpeakerDiarizationResultGetNumSegments(result);
-  const auto *segments =
-      SherpaOnnxOfflineSpeakerDiarizationResultSortByStartTime(result);
+  diarization_segments = collect_segments(result);
 
-  for (int32_t i = 0; i < num_segments; ++i) {
-    DiarizationSegment segment;
-    segment.start = segments[i].start;
-    segment.end = segments[i].end;
-    segment.speaker = segments[i].speaker;
-    diarization_segments.push_back(segment);
+  save_diarization_to_cache(cache_key, diarization_segments);
+
+  return diarization_segments;
+}
+
+// Diarize one window with a worker's own diarizer and extractor. Returns
+// false if sherpa fails to process it
+static bool diarize_window(const SherpaOnnxOfflineSpeakerDiarization *sd,
+                           const SherpaOnnxSpeakerEmbeddingExtractor *extractor,
+                           const SherpaOnnxWave *wave, int32_t start_sample,
+                           int32_t end_sample, DiarizationWindow *window) {
+  const auto *result = SherpaOnnxOfflineSpeakerDiarizationProcess(
+      sd, wave->samples + start_sample, end_sample - start_sample);
+  if (!result) {
+    SPDLOG_ERROR("Failed to diarize window at {:.1f}s",
+                 static_cast<float>(start_sample) / 16000);
+    return false;
+  }
+  // Centroids are computed on window relative timestamps
+  auto local_segments = collect_segments(result);
+  window->centroids = embedding::speaker_centroids(
+      extractor, wave->samples + start_sample, end_sample - start_sample,
+      local_segments);
+
+  float offset = static_cast<float>(start_sample) / 16000;
+  for (auto &segment : local_segments) {
+    segment.start += offset;
+    segment.end += offset;
   }
+  window->segments = local_segments;
+  return true;
+}
 
-  SherpaOnnxOfflineSpeakerDiarizationDestroySegment(segments);
-  SherpaOnnxOfflineSpeakerDiarizationDestroyResult(result);
+bool run_windowed_diarization(
+    const std::string &cache_key, const WindowedConfig &config,
+    const SherpaOnnxWave *wave, progress::Stage &stage,
+    std::vector<DiarizationSegment> &diarization_segments) {
+  diarization_segments = load_diarization_from_cache(cache_key);
+  if (!diarization_segments.empty()) {
+    return true;
+  }
 
-  save_diarization_to_cache(cache_key, diarization_segments);
+  auto start_time = std::chrono::steady_clock::now();
+
+  // Split into windows, each overlapping the previous one
+  int32_t window_size = static_cast<int32_t>(config.window_seconds * 16000);
+  int32_t overlap = static_cast<int32_t>(config.overlap_seconds * 16000);
+  int32_t step = std::max(window_size - overlap, 16000);
+  std::vector<DiarizationWindow> windows;
+  for (int32_t start = 0; start < wave->num_samples; start += step) {
+    DiarizationWindow window;
+    window.start_sample = start;
+    window.end_sample = std::min(start + window_size, wave->num_samples);
+    windows.push_back(window);
+    if (window.end_sample == wave->num_samples) {
+      break;
+    }
+  }
 
-  return diarization_segments;
+  int32_t num_workers = config.num_workers;
+  if (num_workers <= 0) {
+    num_workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_workers = std::min<int32_t>(num_workers, windows.size());
+  // The onnx threads are a budget for all workers, so that more workers
+  // don't oversubscribe the cores
+  int32_t worker_threads = std::max(1, config.onnx_num_threads / num_workers);
+  SPDLOG_INFO("Diarize {} windows of {}s with {} workers of {} onnx threads",
+              windows.size(), config.window_seconds, num_workers,
+              worker_threads);
+
+  std::atomic<int32_t> next_window(0);
+  stage.update(0, static_cast<int64_t>(windows.size()));
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> workers;
+  for (int32_t w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&]() {
+      auto *sd = create_sd(config.segmentation_model_path,
+                           config.embedding_model_path, config.num_clusters,
+                           config.provider, worker_threads);
+      auto *extractor = embedding::create_extractor(
+          config.embedding_model_path, config.provider, worker_threads);
+      if (!sd || !extractor) {
+        failed.store(true);
+      }
+      while (sd && extractor && !failed.load()) {
+        int32_t index = next_window.fetch_add(1);
+        if (index >= static_cast<int32_t>(windows.size())) {
+          break;
+        }
+        auto &window = windows[index];
+        if (!diarize_window(sd, extractor, wave, window.start_sample,
+                            window.end_sample, &window)) {
+          failed.store(true);
+          break;
+        }
+        stage.add(1);
+      }
+      if (extractor) {
+        SherpaOnnxDestroySpeakerEmbeddingExtractor(extractor);
+      }
+      if (sd) {
+        SherpaOnnxDestroyOfflineSpeakerDiarization(sd);
+      }
+    });
+  }
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (failed.load()) {
+    return false;
+  }
+
+  // Link window speakers in time order and keep only the part of each window
+  // closest to its center, so the overlaps aren't reported twice
+  std::vector<std::vector<float>> global_centroids;
+  std::vector<int32_t> global_weights;
+  for (size_t i = 0; i < windows.size(); ++i) {
+    const auto &window = windows[i];
+    auto mapping = embedding::link_speakers(
+        window.centroids, global_centroids, global_weights,
+        config.link_threshold, config.num_clusters);
+
+    // Speakers without an embedding go to the window's main speaker
+    std::map<int32_t, float> speech;
+    for (const auto &segment : window.segments) {
+      if (mapping.count(segment.speaker)) {
+        speech[mapping[segment.speaker]] += segment.end - segment.start;
+      }
+    }
+    int32_t fallback = 0;
+    float fallback_speech = -1.0f;
+    for (const auto &[global, seconds] : speech) {
+      if (seconds > fallback_speech) {
+        fallback = global;
+        fallback_speech = seconds;
+      }
+    }
+
+    float own_start =
+        i == 0 ? 0.0f
+               : (window.start_sample + overlap / 2) / 16000.0f;
+    float own_end = i + 1 == windows.size()
+                        ? wave->num_samples / 16000.0f
+                        : (windows[i + 1].start_sample + overlap / 2) /
+                              16000.0f;
+    for (auto segment : window.segments) {
+      segment.start = std::max(segment.start, own_start);
+      segment.end = std::min(segment.end, own_end);
+      if (segment.end <= segment.start) {
+        continue;
+      }
+      auto it = mapping.find(segment.speaker);
+      segment.speaker = it != mapping.end() ? it->second : fallback;
+
+      // Join segments cut at the window boundary
+      if (!diarization_segments.empty()) {
+        auto &last = diarization_segments.back();
+        if (last.speaker == segment.speaker &&
+            segment.start - last.end < 0.01f) {
+          last.end = std::max(last.end, segment.end);
+          continue;
+        }
+      }
+      diarization_segments.push_back(segment);
+    }
+  }
+
+  std::sort(diarization_segments.begin(), diarization_segments.end(),
+            [](const auto &a, const auto &b) { return a.start < b.start; });
+
+  auto elapsed = std::chrono::duration<float>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  float duration = wave->num_samples / 16000.0f;
+  SPDLOG_INFO("Windowed diarization of {:.1f}s took {:.1f}s with {} workers "
+              "of {} onnx threads (RTF {:.3f}, {} speakers)",
+              duration, elapsed, num_workers, worker_threads,
+              elapsed / duration, global_centroids.size());
+
+  save_diarization_to_cache(cache_key, diarization_segments);
+  return true;
 }
 
 } // namespace diarization
\ No newline at end of file
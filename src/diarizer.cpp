@@ -0,0 +1,61 @@
+#include "diarizer.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+
+namespace diarizer {
+
+std::unique_ptr<SherpaDiarizer>
+SherpaDiarizer::create(const diarization::WindowedConfig &config) {
+  auto *sd = diarization::create_sd(
+      config.segmentation_model_path, config.embedding_model_path,
+      config.num_clusters, config.provider, config.onnx_num_threads);
+  if (!sd) {
+    return nullptr;
+  }
+  return std::unique_ptr<SherpaDiarizer>(new SherpaDiarizer(sd, config));
+}
+
+SherpaDiarizer::SherpaDiarizer(const SherpaOnnxOfflineSpeakerDiarization *sd,
+                               diarization::WindowedConfig config)
+    : sd(sd), config(std::move(config)) {}
+
+SherpaDiarizer::~SherpaDiarizer() {
+  SherpaOnnxDestroyOfflineSpeakerDiarization(sd);
+}
+
+bool SherpaDiarizer::diarize(
+    const SherpaOnnxWave *wave, const std::string &cache_key,
+    progress::Stage &stage,
+    std::vector<diarization::DiarizationSegment> &segments) {
+  // Windowed diarization creates a diarizer per worker instead
+  if (config.window_seconds > 0 &&
+      wave->num_samples > static_cast<int32_t>(config.window_seconds * 16000)) {
+    if (!diarization::run_windowed_diarization(cache_key, config, wave, stage,
+                                               segments)) {
+      SPDLOG_ERROR("Windowed diarization failed");
+      return false;
+    }
+    return true;
+  }
+  segments = diarization::run_diarization(cache_key, sd, wave, stage);
+  return true;
+}
+
+bool MockDiarizer::diarize(
+    const SherpaOnnxWave *wave, const std::string &cache_key,
+    progress::Stage &stage,
+    std::vector<diarization::DiarizationSegment> &segments) {
+  float duration = wave->num_samples / 16000.0f;
+  transcriber::mock_sleep(config, duration);
+  segments.clear();
+  int32_t speaker = 0;
+  for (float start = 0.0f; start < duration; start += turn_seconds) {
+    segments.push_back({start, std::min(start + turn_seconds, duration),
+                        speaker});
+    speaker = (speaker + 1) % std::max(num_speakers, 1);
+  }
+  stage.update(1, 1);
+  return true;
+}
+
+} // namespace diarizer
@@ -2,100 +2,302 @@
 #include "config.h"
 #include "curl/curl.h"
 #include "curl/system.h"
-#include "spinner.h"
+#include "sha256.h"
+#include "progress.h"
 #include "utils.h"
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
 #include <termcolor/termcolor.hpp>
+#include <vector>
 
 namespace fs = std::filesystem;
 
 namespace download {
 
-struct DownloadContext {
-  spinner::Spinner spinner;
-  std::string file_name;
+struct Transfer {
+  Resource resource;
+  std::string part_path;
+  std::ofstream ofs;
+  curl_off_t resume_from = 0;
+  curl_off_t dlnow = 0;
+  curl_off_t dltotal = 0;
+  CURL *curl = nullptr;
 };
 
 static size_t write_callback(char *contents, size_t size, size_t nmemb,
-                             std::ofstream *userp) {
-  userp->write(contents, size * nmemb);
+                             Transfer *transfer) {
+  transfer->ofs.write(contents, size * nmemb);
+  if (!transfer->ofs) {
+    return 0; // Abort transfer on write error
+  }
   return size * nmemb;
 }
 
-static int progress_callback(DownloadContext *ctx, curl_off_t dltotal,
+static int progress_callback(Transfer *transfer, curl_off_t dltotal,
                              curl_off_t dlnow, curl_off_t ultotal,
                              curl_off_t ulnow) {
+  transfer->dltotal = dltotal;
+  transfer->dlnow = dlnow;
+  return 0;
+}
 
-  if (dltotal > 0) {
-    // To avoid issues with extremely small or invalid values
-    int progress = static_cast<int>((dlnow * 100) / dltotal);
-    if (progress >= 0 && progress <= 100) {
-      std::ostringstream message;
-      message << "Download " << ctx->file_name << " " << std::fixed
-              << std::setprecision(0) << progress << "%";
-      ctx->spinner.updateMessage(message.str());
-    }
+static void update_progress(
+    const std::vector<std::unique_ptr<Transfer>> &transfers,
+    progress::Stage &stage) {
+  curl_off_t now = 0;
+  curl_off_t total = 0;
+  for (const auto &transfer : transfers) {
+    // Count already downloaded bytes of resumed files too
+    now += transfer->resume_from + transfer->dlnow;
+    total += transfer->dltotal > 0 ? transfer->resume_from + transfer->dltotal
+                                   : 0;
   }
-  return 0;
+  stage.update(now, total);
 }
 
-void download_file(const std::string url, const std::string path) {
-  DownloadContext ctx;
-  ctx.file_name = path;
-  ctx.spinner.updateMessage("Download " + path + "...");
-  ctx.spinner.start();
-
-  CURLcode res;
-  if (CURL *curl = curl_easy_init(); curl) {
-    std::ofstream ofs(path, std::ios::binary);
-    // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(
-        curl, CURLOPT_WRITEFUNCTION,
-        +[](void *contents, size_t size, size_t nmemb, void *userp) {
-          return write_callback(static_cast<char *>(contents), size, nmemb,
-                                static_cast<std::ofstream *>(userp));
-        });
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ofs);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &ctx);
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS,
-                     0L); // Enable progress tracking
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-  }
-
-  ctx.spinner.stop();
-  if (res == CURLE_OK) {
-    std::cout << termcolor::green << "✓" << termcolor::reset << " Download "
-              << path << " complete!" << std::endl;
+static bool verify_and_commit(Transfer &transfer) {
+  const auto &resource = transfer.resource;
+  if (resource.sha256.empty()) {
+    SPDLOG_WARN("No checksum configured for {}, skipping verification",
+                resource.path);
   } else {
-    std::cerr << termcolor::red << "✗" << termcolor::reset << " Download of "
-              << path << " from " << url
-              << " failed: " << curl_easy_strerror(res) << std::endl;
+    auto digest = sha256::file_digest(transfer.part_path);
+    if (digest != resource.sha256) {
+      std::cerr << termcolor::red << "✗" << termcolor::reset << " Checksum of "
+                << resource.path << " mismatch (expected " << resource.sha256
+                << ", got " << digest << ")" << std::endl;
+      // Corrupted data can't be resumed
+      fs::remove(transfer.part_path);
+      return false;
+    }
   }
+
+  std::error_code ec;
+  fs::rename(transfer.part_path, resource.path, ec);
+  if (ec) {
+    std::cerr << termcolor::red << "✗" << termcolor::reset << " Failed to move "
+              << transfer.part_path << " to " << resource.path << ": "
+              << ec.message() << std::endl;
+    return false;
+  }
+  return true;
 }
-void download_resources_if_needed() {
-  if (!utils::is_program_installed("ffmpeg")) {
-    download_file(config::ffmpeg_url, config::ffmpeg_name);
-    utils::set_executable(config::ffmpeg_name);
+
+static CURL *create_handle(Transfer &transfer) {
+  CURL *curl = curl_easy_init();
+  if (!curl) {
+    return nullptr;
   }
+  transfer.curl = curl;
+
+  // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  curl_easy_setopt(curl, CURLOPT_URL, transfer.resource.url.c_str());
+  curl_easy_setopt(
+      curl, CURLOPT_WRITEFUNCTION,
+      +[](void *contents, size_t size, size_t nmemb, void *userp) {
+        return write_callback(static_cast<char *>(contents), size, nmemb,
+                              static_cast<Transfer *>(userp));
+      });
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &transfer);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS,
+                   0L); // Enable progress tracking
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+  if (transfer.resume_from > 0) {
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, transfer.resume_from);
+  }
+  return curl;
+}
+
+// Drop the .part of transfer and download it again from byte 0
+static bool restart(CURLM *multi, Transfer &transfer) {
+  curl_multi_remove_handle(multi, transfer.curl);
+  curl_easy_cleanup(transfer.curl);
+  transfer.curl = nullptr;
+  transfer.resume_from = 0;
+  transfer.dlnow = 0;
+  transfer.dltotal = 0;
+  transfer.ofs.open(transfer.part_path, std::ios::binary | std::ios::trunc);
+  CURL *curl = create_handle(transfer);
+  if (!curl || !transfer.ofs.is_open()) {
+    return false;
+  }
+  curl_multi_add_handle(multi, curl);
+  return true;
+}
+
+// A .part answered by 416 is complete only if it matches the digest. Without
+// one it can't be told from a corrupt .part, and is downloaded again
+static bool part_complete(const Transfer &transfer) {
+  const auto &resource = transfer.resource;
+  return !resource.sha256.empty() &&
+         sha256::file_digest(transfer.part_path) == resource.sha256;
+}
+
+bool download_files(const std::vector<Resource> &resources) {
+  if (resources.empty()) {
+    return true;
+  }
+
+  std::vector<std::unique_ptr<Transfer>> transfers;
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    std::cerr << "Failed to initialize curl" << std::endl;
+    return false;
+  }
+
+  for (const auto &resource : resources) {
+    auto transfer = std::make_unique<Transfer>();
+    transfer->resource = resource;
+    transfer->part_path = resource.path + ".part";
+
+    std::error_code ec;
+    if (fs::exists(transfer->part_path, ec)) {
+      transfer->resume_from =
+          static_cast<curl_off_t>(fs::file_size(transfer->part_path, ec));
+      SPDLOG_INFO("Resume {} from {} bytes", resource.path,
+                  transfer->resume_from);
+    }
+    transfer->ofs.open(transfer->part_path, std::ios::binary | std::ios::app);
 
+    CURL *curl = create_handle(*transfer);
+    if (!curl || !transfer->ofs.is_open()) {
+      if (curl) {
+        curl_easy_cleanup(curl);
+      }
+      std::cerr << "Failed to prepare download of " << resource.path
+                << std::endl;
+      continue;
+    }
+    curl_multi_add_handle(multi, curl);
+    transfers.push_back(std::move(transfer));
+  }
+
+  auto &stage = progress::begin(
+      "download", "Download " + std::to_string(transfers.size()) + " file(s)");
+
+  bool success = transfers.size() == resources.size();
+  int running = 0;
+  do {
+    CURLMcode mc = curl_multi_perform(multi, &running);
+    if (mc == CURLM_OK && running) {
+      mc = curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+    }
+    if (mc != CURLM_OK) {
+      std::cerr << "curl multi failed: " << curl_multi_strerror(mc)
+                << std::endl;
+      success = false;
+      break;
+    }
+    update_progress(transfers, stage);
+
+    // Finalize completed transfers while others keep running
+    int queued = 0;
+    while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      Transfer *transfer = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+      transfer->ofs.close();
+
+      CURLcode res = msg->data.result;
+      long status = 0;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &status);
+      // Some libcurl versions report a 416 answer to a resume as success
+      bool done = res == CURLE_OK && status != 416;
+      if (!done && transfer->resume_from > 0) {
+        // 416 means the .part may already hold the whole resource. Range
+        // errors mean the server ignored the range request
+        if (status == 416 && part_complete(*transfer)) {
+          done = true;
+        } else if (status == 416 || res == CURLE_RANGE_ERROR) {
+          SPDLOG_INFO("Can't resume {}, restarting download",
+                      transfer->resource.path);
+          if (restart(multi, *transfer)) {
+            running++;
+            continue;
+          }
+        }
+      }
+
+      auto lock = progress::pause();
+      bool committed = done && verify_and_commit(*transfer);
+      if (committed) {
+        std::cout << termcolor::green << "✓" << termcolor::reset
+                  << " Download " << transfer->resource.path << " complete!"
+                  << std::endl;
+      } else {
+        if (!done) {
+          std::cerr << termcolor::red << "✗" << termcolor::reset
+                    << " Download of " << transfer->resource.path << " from "
+                    << transfer->resource.url
+                    << " failed: " << curl_easy_strerror(res) << std::endl;
+        }
+        success = false;
+      }
+    }
+  } while (running);
+
+  progress::end(stage);
+  for (auto &transfer : transfers) {
+    curl_multi_remove_handle(multi, transfer->curl);
+    curl_easy_cleanup(transfer->curl);
+  }
+  curl_multi_cleanup(multi);
+  return success;
+}
+
+bool download_file(const std::string url, const std::string path,
+                   const std::string sha256) {
+  return download_files({{url, path, sha256}});
+}
+
+bool download_resources_if_needed() {
+  std::vector<Resource> resources;
+  bool need_ffmpeg = !utils::is_program_installed("ffmpeg");
+  if (need_ffmpeg) {
+    resources.push_back(
+        {config::ffmpeg_url, config::ffmpeg_name, config::ffmpeg_sha256});
+  }
   if (!fs::exists(config::segmentation_name)) {
-    download_file(config::segmentation_url, config::segmentation_name);
+    resources.push_back({config::segmentation_url, config::segmentation_name,
+                         config::segmentation_sha256});
   }
   if (!fs::exists(config::embedding_name)) {
-    download_file(config::embedding_url, config::embedding_name);
+    resources.push_back({config::embedding_url, config::embedding_name,
+                         config::embedding_sha256});
+  }
+  if (!fs::exists(config::vad_name)) {
+    resources.push_back(
+        {config::vad_url, config::vad_name, config::vad_sha256});
   }
   if (!fs::exists(config::ggml_tiny_name)) {
-    download_file(config::ggml_tiny_url, config::ggml_tiny_name);
+    resources.push_back({config::ggml_tiny_url, config::ggml_tiny_name,
+                         config::ggml_tiny_sha256});
+  }
+
+  // Resources without a digest in config.cpp are downloaded unverified
+  for (const auto &resource : resources) {
+    if (resource.sha256.empty()) {
+      std::cerr << termcolor::yellow << "!" << termcolor::reset
+                << " No checksum pinned for " << resource.path
+                << ", downloading " << resource.url << " unverified"
+                << std::endl;
+    }
+  }
+  bool success = download_files(resources);
+
+  if (need_ffmpeg && fs::exists(config::ffmpeg_name)) {
+    utils::set_executable(config::ffmpeg_name);
   }
+  return success;
 }
 
-} // namespace download
\ No newline at end of file
+} // namespace download
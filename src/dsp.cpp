@@ -0,0 +1,236 @@
+#include "dsp.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define DSP_X86_64
+#ifdef _WIN32
+#define NOMINMAX
+#include <intrin.h>
+#include <windows.h>
+#ifndef PF_AVX2_INSTRUCTIONS_AVAILABLE
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+#endif
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The AVX2 kernels are compiled for AVX2 whatever the build flags, and only
+// called when cpuid reports it
+#if defined(DSP_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(DSP_X86_64)
+#define TARGET_AVX2
+#endif
+
+namespace dsp {
+
+static const double pi = 3.14159265358979323846;
+
+FFT::FFT(size_t size) : n(size), twiddles(size) {
+  for (size_t k = 0; k < n; k++) {
+    double angle = -2.0 * pi * k / n;
+    twiddles[k] = {static_cast<float>(std::cos(angle)),
+                   static_cast<float>(std::sin(angle))};
+  }
+}
+
+void FFT::transform(const float *in, size_t length, size_t stride,
+                    std::complex<float> *out) const {
+  if (length == 1) {
+    out[0] = in[0];
+    return;
+  }
+  size_t step = n / length;
+  if (length % 2 != 0) {
+    for (size_t k = 0; k < length; k++) {
+      std::complex<float> sum = 0.0f;
+      for (size_t j = 0; j < length; j++) {
+        sum += in[j * stride] * twiddles[(j * k % length) * step];
+      }
+      out[k] = sum;
+    }
+    return;
+  }
+
+  size_t half = length / 2;
+  transform(in, half, stride * 2, out);
+  transform(in + stride, half, stride * 2, out + half);
+  for (size_t k = 0; k < half; k++) {
+    auto even = out[k];
+    auto odd = twiddles[k * step] * out[k + half];
+    out[k] = even + odd;
+    out[k + half] = even - odd;
+  }
+}
+
+void FFT::forward(const float *in, std::complex<float> *out) const {
+  transform(in, n, 1, out);
+}
+
+PowerSpectrum::PowerSpectrum(size_t n_fft)
+    : fft(n_fft), window(n_fft), windowed(n_fft), spectrum(n_fft) {
+  // Periodic Hann, like torch.hann_window
+  for (size_t i = 0; i < n_fft; i++) {
+    window[i] =
+        static_cast<float>(0.5 * (1.0 - std::cos(2.0 * pi * i / n_fft)));
+  }
+}
+
+void PowerSpectrum::compute(const float *frame, float *power) {
+  for (size_t i = 0; i < window.size(); i++) {
+    windowed[i] = frame[i] * window[i];
+  }
+  fft.forward(windowed.data(), spectrum.data());
+  for (size_t k = 0; k < num_bins(); k++) {
+    power[k] = std::norm(spectrum[k]);
+  }
+}
+
+#ifdef DSP_X86_64
+static bool cpu_has_avx2() {
+#ifdef _WIN32
+  int info[4];
+  __cpuid(info, 1);
+  bool fma = info[2] & (1 << 12);
+  // Also checks that the OS saves the AVX registers
+  return fma && IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE);
+#else
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static const bool use_avx2 = cpu_has_avx2();
+
+TARGET_AVX2 static float dot_avx2(const float *a, const float *b, int32_t n) {
+  int32_t i = 0;
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (; i + 16 <= n; i += 16) {
+    acc0 =
+        _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+                           _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc),
+                           _mm256_extractf128_ps(acc, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+  float sum = _mm_cvtss_f32(half);
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+TARGET_AVX2 static int32_t dot_int8_avx2(const int8_t *a, const int8_t *b,
+                                         int32_t n) {
+  int32_t i = 0;
+  __m256i acc = _mm256_setzero_si256();
+  for (; i + 16 <= n; i += 16) {
+    __m256i va = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+    __m256i vb = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+  }
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                               _mm256_extracti128_si256(acc, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+  int32_t sum = _mm_cvtsi128_si32(half);
+  for (; i < n; ++i) {
+    sum += static_cast<int32_t>(a[i]) * b[i];
+  }
+  return sum;
+}
+#endif
+
+const char *simd_path() {
+#ifdef DSP_X86_64
+  return use_avx2 ? "avx2" : "sse2";
+#elif defined(__SSE2__)
+  return "sse2";
+#elif defined(__ARM_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+float dot(const float *a, const float *b, int32_t n) {
+#ifdef DSP_X86_64
+  if (use_avx2) {
+    return dot_avx2(a, b, n);
+  }
+#endif
+  int32_t i = 0;
+  float sum = 0.0f;
+#if defined(DSP_X86_64) || defined(__SSE2__)
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (; i + 8 <= n; i += 8) {
+    acc0 =
+        _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 acc = _mm_add_ps(acc0, acc1);
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+  sum = _mm_cvtss_f32(acc);
+#elif defined(__ARM_NEON)
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  for (; i + 4 <= n; i += 4) {
+    acc = vfmaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+  sum = vaddvq_f32(acc);
+#endif
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+int32_t dot_int8(const int8_t *a, const int8_t *b, int32_t n) {
+#ifdef DSP_X86_64
+  if (use_avx2) {
+    return dot_int8_avx2(a, b, n);
+  }
+#endif
+  int32_t i = 0;
+  int32_t sum = 0;
+#if defined(DSP_X86_64) || defined(__SSE2__)
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    // Sign extend to int16 by placing the bytes in the high half
+    __m128i va_lo = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+    __m128i va_hi = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+    __m128i vb_lo = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+    __m128i vb_hi = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(va_lo, vb_lo));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(va_hi, vb_hi));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  sum = _mm_cvtsi128_si32(acc);
+#elif defined(__ARM_NEON)
+  int32x4_t acc = vdupq_n_s32(0);
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t prod = vmull_s8(vld1_s8(a + i), vld1_s8(b + i));
+    acc = vpadalq_s16(acc, prod);
+  }
+  sum = vaddvq_s32(acc);
+#endif
+  for (; i < n; ++i) {
+    sum += static_cast<int32_t>(a[i]) * b[i];
+  }
+  return sum;
+}
+} // namespace dsp
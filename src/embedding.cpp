@@ -0,0 +1,243 @@
+#include "embedding.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <tuple>
+
+namespace embedding {
+
+static const double pi = 3.14159265358979323846;
+
+const SherpaOnnxSpeakerEmbeddingExtractor *
+create_extractor(const std::string &embedding_model_path,
+                 const std::string &provider, int32_t onnx_num_threads) {
+  SherpaOnnxSpeakerEmbeddingExtractorConfig config;
+  memset(&config, 0, sizeof(config));
+  config.model = embedding_model_path.c_str();
+  config.provider = provider.c_str();
+  config.num_threads = onnx_num_threads;
+  auto *extractor = SherpaOnnxCreateSpeakerEmbeddingExtractor(&config);
+  if (!extractor) {
+    std::cerr << "Failed to initialize speaker embedding extractor"
+              << std::endl;
+    return nullptr;
+  }
+  return extractor;
+}
+
+void normalize(std::vector<float> &v) {
+  float norm = 0.0f;
+  for (float x : v) {
+    norm += x * x;
+  }
+  norm = std::sqrt(norm);
+  if (norm > 0.0f) {
+    for (float &x : v) {
+      x /= norm;
+    }
+  }
+}
+
+std::vector<float>
+compute_embedding(const SherpaOnnxSpeakerEmbeddingExtractor *extractor,
+                  const float *samples, int32_t n_samples) {
+  std::vector<float> result;
+  const SherpaOnnxOnlineStream *stream =
+      SherpaOnnxSpeakerEmbeddingExtractorCreateStream(extractor);
+  SherpaOnnxOnlineStreamAcceptWaveform(stream, 16000, samples, n_samples);
+  SherpaOnnxOnlineStreamInputFinished(stream);
+
+  if (SherpaOnnxSpeakerEmbeddingExtractorIsReady(extractor, stream)) {
+    const float *v =
+        SherpaOnnxSpeakerEmbeddingExtractorComputeEmbedding(extractor, stream);
+    int32_t dim = SherpaOnnxSpeakerEmbeddingExtractorDim(extractor);
+    result.assign(v, v + dim);
+    SherpaOnnxSpeakerEmbeddingExtractorDestroyEmbedding(v);
+    normalize(result);
+  }
+  SherpaOnnxDestroyOnlineStream(stream);
+  return result;
+}
+
+std::vector<float> mock_embedding(const float *samples, int32_t n_samples) {
+  // Goertzel filter per band
+  const int32_t num_bands = 16;
+  std::vector<float> result(num_bands);
+  for (int32_t band = 0; band < num_bands; band++) {
+    double omega = 2.0 * pi * 100.0 * (band + 1) / 16000.0;
+    double coeff = 2.0 * std::cos(omega);
+    double s1 = 0.0, s2 = 0.0;
+    for (int32_t i = 0; i < n_samples; i++) {
+      double s0 = samples[i] + coeff * s1 - s2;
+      s2 = s1;
+      s1 = s0;
+    }
+    result[band] = static_cast<float>(
+        std::sqrt(std::max(0.0, s1 * s1 + s2 * s2 - coeff * s1 * s2)));
+  }
+  normalize(result);
+  return result;
+}
+
+float cosine_similarity(const std::vector<float> &a,
+                        const std::vector<float> &b) {
+  if (a.size() != b.size() || a.empty()) {
+    return 0.0f;
+  }
+  float dot = 0.0f, norm_a = 0.0f, norm_b = 0.0f;
+  for (size_t i = 0; i < a.size(); ++i) {
+    dot += a[i] * b[i];
+    norm_a += a[i] * a[i];
+    norm_b += b[i] * b[i];
+  }
+  if (norm_a == 0.0f || norm_b == 0.0f) {
+    return 0.0f;
+  }
+  return dot / (std::sqrt(norm_a) * std::sqrt(norm_b));
+}
+
+std::map<int32_t, std::vector<float>>
+speaker_centroids(const SherpaOnnxSpeakerEmbeddingExtractor *extractor,
+                  const float *samples, int32_t n_samples,
+                  const std::vector<diarization::DiarizationSegment> &segments,
+                  int32_t max_segments_per_speaker) {
+  auto embed = [extractor](const float *samples, int32_t n_samples) {
+    return compute_embedding(extractor, samples, n_samples);
+  };
+  return speaker_centroids(embed, samples, n_samples, segments,
+                           max_segments_per_speaker);
+}
+
+std::map<int32_t, std::vector<float>>
+speaker_centroids(const Embed &embed, const float *samples, int32_t n_samples,
+                  const std::vector<diarization::DiarizationSegment> &segments,
+                  int32_t max_segments_per_speaker) {
+  // Longest segments give the most reliable embeddings
+  std::map<int32_t, std::vector<diarization::DiarizationSegment>> by_speaker;
+  for (const auto &segment : segments) {
+    by_speaker[segment.speaker].push_back(segment);
+  }
+
+  std::map<int32_t, std::vector<float>> centroids;
+  for (auto &[speaker, speaker_segments] : by_speaker) {
+    std::sort(speaker_segments.begin(), speaker_segments.end(),
+              [](const auto &a, const auto &b) {
+                return (a.end - a.start) > (b.end - b.start);
+              });
+
+    std::vector<float> centroid;
+    int32_t used = 0;
+    for (const auto &segment : speaker_segments) {
+      if (used >= max_segments_per_speaker) {
+        break;
+      }
+      int32_t start = std::max(0, static_cast<int32_t>(segment.start * 16000));
+      int32_t end =
+          std::min(n_samples, static_cast<int32_t>(segment.end * 16000));
+      if (end <= start) {
+        continue;
+      }
+      auto v = embed(samples + start, end - start);
+      if (v.empty()) {
+        continue;
+      }
+      if (centroid.empty()) {
+        centroid.assign(v.size(), 0.0f);
+      }
+      for (size_t i = 0; i < v.size(); ++i) {
+        centroid[i] += v[i];
+      }
+      used++;
+    }
+
+    if (!centroid.empty()) {
+      normalize(centroid);
+      centroids[speaker] = centroid;
+    }
+  }
+  return centroids;
+}
+
+std::map<int32_t, int32_t>
+link_speakers(const std::map<int32_t, std::vector<float>> &local_centroids,
+              std::vector<std::vector<float>> &global_centroids,
+              std::vector<int32_t> &global_weights, float threshold,
+              int32_t max_speakers) {
+  // All (similarity, local, global) pairs, best first
+  std::vector<std::tuple<float, int32_t, int32_t>> pairs;
+  for (const auto &[local, centroid] : local_centroids) {
+    for (int32_t g = 0; g < static_cast<int32_t>(global_centroids.size());
+         ++g) {
+      pairs.emplace_back(cosine_similarity(centroid, global_centroids[g]),
+                         local, g);
+    }
+  }
+  std::sort(pairs.begin(), pairs.end(),
+            [](const auto &a, const auto &b) {
+              return std::get<0>(a) > std::get<0>(b);
+            });
+
+  std::map<int32_t, int32_t> mapping;
+  std::set<int32_t> used_globals;
+  for (const auto &[similarity, local, global] : pairs) {
+    if (similarity < threshold) {
+      break;
+    }
+    if (mapping.count(local) || used_globals.count(global)) {
+      continue;
+    }
+    mapping[local] = global;
+    used_globals.insert(global);
+  }
+
+  // Unmatched speakers become new global speakers, or fall back to the
+  // closest free one once the speaker limit is reached
+  for (const auto &[local, centroid] : local_centroids) {
+    if (mapping.count(local)) {
+      continue;
+    }
+    bool can_create =
+        max_speakers <= 0 ||
+        static_cast<int32_t>(global_centroids.size()) < max_speakers;
+    if (can_create || global_centroids.empty()) {
+      int32_t global = static_cast<int32_t>(global_centroids.size());
+      global_centroids.push_back(centroid);
+      global_weights.push_back(0);
+      mapping[local] = global;
+      used_globals.insert(global);
+      continue;
+    }
+    for (const auto &[similarity, pair_local, global] : pairs) {
+      if (pair_local != local) {
+        continue;
+      }
+      if (!used_globals.count(global) ||
+          used_globals.size() >= global_centroids.size()) {
+        mapping[local] = global;
+        used_globals.insert(global);
+        break;
+      }
+    }
+  }
+
+  // Update running centroids with the linked chunk
+  for (const auto &[local, global] : mapping) {
+    const auto &centroid = local_centroids.at(local);
+    auto &target = global_centroids[global];
+    int32_t weight = global_weights[global];
+    for (size_t i = 0; i < target.size() && i < centroid.size(); ++i) {
+      target[i] = target[i] * weight + centroid[i];
+    }
+    normalize(target);
+    global_weights[global] = weight + 1;
+  }
+
+  SPDLOG_DEBUG("linked {} local speakers to {} global speakers",
+               local_centroids.size(), global_centroids.size());
+  return mapping;
+}
+
+} // namespace embedding
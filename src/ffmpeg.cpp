@@ -12,27 +12,30 @@
 
 namespace ffmpeg {
 
-void normalize_audio(std::string input, std::string output) {
+void normalize_audio(std::string input, std::string output,
+                     bool keep_channels, float start, float end) {
   SPDLOG_INFO("Normalizing audio from {} to {}", input, output);
 
   using subprocess::CompletedProcess;
   using subprocess::PipeOption;
   using subprocess::RunBuilder;
 
+  std::vector<std::string> command = {"ffmpeg"};
+  // Before the input ffmpeg seeks in the container instead of decoding up to
+  // start. The duration then counts from the seek point
+  if (start > 0.0f) {
+    command.insert(command.end(), {"-ss", std::to_string(start)});
+  }
+  command.insert(command.end(), {"-i", input, "-ar", "16000"});
+  if (end > 0.0f) {
+    command.insert(command.end(), {"-t", std::to_string(end - start)});
+  }
+  if (!keep_channels) {
+    command.insert(command.end(), {"-ac", "1"});
+  }
+  command.insert(command.end(), {"-c:a", "pcm_s16le", output});
   CompletedProcess proc = subprocess::run(
-      {
-          "ffmpeg",
-          "-i",
-          input,
-          "-ar",
-          "16000",
-          "-ac",
-          "1",
-          "-c:a",
-          "pcm_s16le",
-          output,
-      },
-      RunBuilder().cout(PipeOption::cerr).cerr(PipeOption::pipe));
+      command, RunBuilder().cout(PipeOption::cerr).cerr(PipeOption::pipe));
 }
 
 void show_ffmpeg_normalize_suggestion(const std::string &audio_path, int argc,
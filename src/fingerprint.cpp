@@ -0,0 +1,387 @@
+#include "fingerprint.h"
+#include "dsp.h"
+#include "spdlog/spdlog.h"
+#include "utils.h"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fingerprint {
+
+static const char magic[8] = {'L', 'O', 'U', 'D', 'F', 'P', 'I', '2'};
+
+static constexpr int32_t frame_size = 1024; // 64ms
+static constexpr int32_t hop_size = 256;    // 16ms
+static constexpr int32_t num_bands = 33;    // 32 bits from 33 bands
+static constexpr float min_frequency = 300.0f;
+static constexpr float max_frequency = 3000.0f;
+// Only every other frame of an entry is posted, any of them can anchor a
+// match since the query is scanned frame by frame
+static constexpr uint32_t posting_stride = 2;
+// Keys shared by this many frames carry no information
+static constexpr size_t max_postings = 512;
+
+// Each half of a sub-fingerprint is a key. A full 32 bit match is rare at
+// the bit error rates of re-encoded audio, a 16 bit one isn't
+static uint32_t key(uint32_t value, int half) {
+  return half == 0 ? (value & 0xFFFF) : (value >> 16) | 0x10000;
+}
+
+Fingerprint compute(const float *samples, int32_t n_samples) {
+  Fingerprint fp;
+  if (n_samples < frame_size + hop_size) {
+    return fp;
+  }
+
+  // Log spaced band edges as FFT bins
+  static const std::vector<int32_t> edges = [] {
+    std::vector<int32_t> bins(num_bands + 1);
+    for (int32_t m = 0; m <= num_bands; m++) {
+      float frequency =
+          min_frequency *
+          std::pow(max_frequency / min_frequency,
+                   static_cast<float>(m) / num_bands);
+      bins[m] = static_cast<int32_t>(frequency * frame_size / 16000);
+    }
+    return bins;
+  }();
+
+  dsp::PowerSpectrum spectrum(frame_size);
+  std::vector<float> power(spectrum.num_bins());
+  std::vector<float> previous(num_bands);
+  std::vector<float> bands(num_bands);
+  int32_t num_frames = (n_samples - frame_size) / hop_size + 1;
+  fp.reserve(num_frames - 1);
+  for (int32_t f = 0; f < num_frames; f++) {
+    spectrum.compute(samples + f * hop_size, power.data());
+    for (int32_t m = 0; m < num_bands; m++) {
+      float energy = 0.0f;
+      for (int32_t k = edges[m]; k < std::max(edges[m + 1], edges[m] + 1);
+           k++) {
+        energy += power[k];
+      }
+      bands[m] = energy;
+    }
+    if (f > 0) {
+      uint32_t bits = 0;
+      for (int32_t m = 0; m < num_bands - 1; m++) {
+        float diff =
+            (bands[m] - bands[m + 1]) - (previous[m] - previous[m + 1]);
+        if (diff > 0) {
+          bits |= 1u << m;
+        }
+      }
+      fp.push_back(bits);
+    }
+    std::swap(previous, bands);
+  }
+  return fp;
+}
+
+float bit_error_rate(const Fingerprint &a, const Fingerprint &b,
+                     int32_t offset, int32_t &overlap) {
+  int32_t begin = std::max(0, -offset);
+  int32_t end = std::min(static_cast<int32_t>(a.size()),
+                         static_cast<int32_t>(b.size()) - offset);
+  overlap = std::max(0, end - begin);
+  if (overlap == 0) {
+    return 1.0f;
+  }
+  size_t errors = 0;
+  for (int32_t i = begin; i < end; i++) {
+    errors += std::bitset<32>(a[i] ^ b[i + offset]).count();
+  }
+  return static_cast<float>(errors) / (overlap * 32);
+}
+
+void Index::post(uint32_t entry) {
+  const auto &fp = entries[entry].fp;
+  for (uint32_t f = 0; f < fp.size(); f += posting_stride) {
+    // Silence has no energy differences
+    if (fp[f] == 0) {
+      continue;
+    }
+    for (int half = 0; half < 2; half++) {
+      postings[key(fp[f], half)].push_back({entry, f});
+    }
+  }
+}
+
+void Index::rebuild() {
+  postings.clear();
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    post(i);
+  }
+}
+
+void Index::prune() {
+  // Keep the entries that matched most and most recently
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.hits != b.hits ? a.hits > b.hits
+                                      : a.last_used > b.last_used;
+            });
+  entries.resize(max_entries * 9 / 10);
+  rebuild();
+}
+
+bool Index::lookup(const Fingerprint &query, std::string &text) {
+  counters.lookups++;
+  if (query.empty() || entries.empty()) {
+    return false;
+  }
+
+  // Vote for (entry, offset) pairs of matching sub-fingerprints
+  std::unordered_map<uint64_t, int32_t> votes;
+  for (uint32_t i = 0; i < query.size(); i++) {
+    if (query[i] == 0) {
+      continue;
+    }
+    for (int half = 0; half < 2; half++) {
+      auto it = postings.find(key(query[i], half));
+      if (it == postings.end() || it->second.size() > max_postings) {
+        continue;
+      }
+      for (const auto &[entry, frame] : it->second) {
+        auto offset = static_cast<int32_t>(frame) - static_cast<int32_t>(i);
+        votes[static_cast<uint64_t>(entry) << 32 |
+              static_cast<uint32_t>(offset)]++;
+      }
+    }
+  }
+
+  std::vector<std::pair<int32_t, uint64_t>> candidates;
+  for (const auto &[key, count] : votes) {
+    if (count >= 3) {
+      candidates.push_back({count, key});
+    }
+  }
+  std::sort(candidates.rbegin(), candidates.rend());
+  if (candidates.size() > 5) {
+    candidates.resize(5);
+  }
+
+  for (const auto &[count, key] : candidates) {
+    auto &entry = entries[key >> 32];
+    auto offset = static_cast<int32_t>(static_cast<uint32_t>(key));
+    int32_t overlap = 0;
+    float ber = bit_error_rate(query, entry.fp, offset, overlap);
+    size_t longest = std::max(query.size(), entry.fp.size());
+    if (ber <= max_bit_error_rate && overlap >= min_coverage * longest) {
+      SPDLOG_DEBUG("fingerprint match with {} votes, ber {:.3f}", count, ber);
+      entry.hits++;
+      entry.last_used = ++clock;
+      counters.hits++;
+      counters.hit_seconds += query.size() * hop_size / 16000.0;
+      text = entry.text;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Index::add(Fingerprint fp, const std::string &text) {
+  if (fp.empty()) {
+    return;
+  }
+  Entry entry;
+  entry.fp = std::move(fp);
+  entry.text = text;
+  entry.last_used = ++clock;
+  entries.push_back(std::move(entry));
+  post(static_cast<uint32_t>(entries.size() - 1));
+  if (entries.size() > max_entries) {
+    prune();
+  }
+}
+
+template <typename T> static void write_pod(std::ofstream &ofs, const T &v) {
+  ofs.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T> static bool read_pod(std::ifstream &ifs, T &v) {
+  ifs.read(reinterpret_cast<char *>(&v), sizeof(T));
+  return static_cast<bool>(ifs);
+}
+
+void Index::merge(const Index &other) {
+  // Entries are the same if both the fingerprint and the text are
+  auto same = [](const Entry &a, const Entry &b) {
+    return a.fp == b.fp && a.text == b.text;
+  };
+  std::unordered_multimap<size_t, uint32_t> known;
+  auto hash = [](const Entry &entry) {
+    return std::hash<std::string>()(entry.text) ^ entry.fp.size() ^
+           (entry.fp.empty() ? 0 : entry.fp.front());
+  };
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    known.insert({hash(entries[i]), i});
+  }
+  size_t added = 0;
+  for (const auto &entry : other.entries) {
+    auto range = known.equal_range(hash(entry));
+    auto it = std::find_if(range.first, range.second, [&](const auto &item) {
+      return same(entries[item.second], entry);
+    });
+    if (it != range.second) {
+      auto &own = entries[it->second];
+      own.hits = std::max(own.hits, entry.hits);
+      continue;
+    }
+    entries.push_back(entry);
+    added++;
+  }
+  SPDLOG_DEBUG("Merged {} fingerprints saved by other runs", added);
+  if (entries.size() > max_entries) {
+    prune();
+  }
+}
+
+bool Index::save(const std::string &path) {
+  // Runs sharing the index merge into what's on disk under a lock, so none
+  // of them drops the others' entries
+  utils::FileLock lock(path);
+  if (!lock.locked()) {
+    std::cerr << "Error: Could not lock " << path << std::endl;
+    return false;
+  }
+  Index saved;
+  saved.model = model;
+  saved.language = language;
+  if (std::filesystem::exists(path)) {
+    if (saved.load(path)) {
+      merge(saved);
+    } else if (saved.foreign) {
+      return false;
+    } else {
+      SPDLOG_WARN("Replacing unreadable fingerprint index {}", path);
+    }
+  }
+
+  // Most recently used last, so the order restores the clock
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.last_used < b.last_used;
+            });
+  rebuild();
+
+  std::string tmp_path = path + "." + utils::get_random_string(8) + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.is_open()) {
+      std::cerr << "Error: Could not open file for writing: " << path
+                << std::endl;
+      return false;
+    }
+    ofs.write(magic, sizeof(magic));
+    for (const auto *field : {&model, &language}) {
+      write_pod(ofs, static_cast<uint32_t>(field->size()));
+      ofs.write(field->data(), field->size());
+    }
+    write_pod(ofs, static_cast<uint32_t>(entries.size()));
+    for (const auto &entry : entries) {
+      write_pod(ofs, static_cast<uint32_t>(entry.text.size()));
+      ofs.write(entry.text.data(), entry.text.size());
+      write_pod(ofs, entry.hits);
+      write_pod(ofs, static_cast<uint32_t>(entry.fp.size()));
+      ofs.write(reinterpret_cast<const char *>(entry.fp.data()),
+                entry.fp.size() * sizeof(uint32_t));
+    }
+    if (!ofs) {
+      ofs.close();
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+bool Index::load(const std::string &path) {
+  foreign = false;
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  char file_magic[sizeof(magic)];
+  ifs.read(file_magic, sizeof(file_magic));
+  if (!ifs || memcmp(file_magic, magic, sizeof(magic)) != 0) {
+    std::cerr << path << " is not a fingerprint index" << std::endl;
+    return false;
+  }
+
+  // Sizes are checked against the bytes left before allocating, so a
+  // truncated or corrupt index can't ask for gigabytes
+  std::error_code ec;
+  auto file_size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+  auto remaining = [&]() {
+    return file_size - static_cast<uint64_t>(ifs.tellg());
+  };
+  // Text size, hits and fingerprint size
+  const uint64_t min_entry_size = 3 * sizeof(uint32_t);
+
+  std::string saved_model;
+  std::string saved_language;
+  for (auto *field : {&saved_model, &saved_language}) {
+    uint32_t size = 0;
+    if (!read_pod(ifs, size) || size > remaining()) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      return false;
+    }
+    field->resize(size);
+    ifs.read(field->data(), size);
+  }
+  foreign = saved_model != model || saved_language != language;
+  if (foreign) {
+    std::cerr << path << " holds transcripts of " << saved_model << " ("
+              << saved_language << "), not " << model << " (" << language
+              << ")" << std::endl;
+    return false;
+  }
+
+  uint32_t count = 0;
+  if (!read_pod(ifs, count) || count > remaining() / min_entry_size) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    return false;
+  }
+  std::vector<Entry> loaded(count);
+  for (auto &entry : loaded) {
+    uint32_t text_size = 0;
+    uint32_t fp_size = 0;
+    if (!read_pod(ifs, text_size) || text_size > remaining()) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      return false;
+    }
+    entry.text.resize(text_size);
+    ifs.read(entry.text.data(), text_size);
+    if (!read_pod(ifs, entry.hits) || !read_pod(ifs, fp_size) ||
+        fp_size > remaining() / sizeof(uint32_t)) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      return false;
+    }
+    entry.fp.resize(fp_size);
+    ifs.read(reinterpret_cast<char *>(entry.fp.data()),
+             fp_size * sizeof(uint32_t));
+    if (!ifs) {
+      return false;
+    }
+    entry.last_used = ++clock;
+  }
+  entries = std::move(loaded);
+  rebuild();
+  return true;
+}
+
+} // namespace fingerprint
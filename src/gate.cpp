@@ -0,0 +1,83 @@
+#include "gate.h"
+#include "dsp.h"
+#include "spdlog/spdlog.h"
+#include <chrono>
+#include <cmath>
+
+namespace gate {
+
+// 32ms frames, a power of two for the FFT
+static const int32_t frame_size = 512;
+// Bins of the 125Hz to 4kHz band, where voiced speech has its harmonics
+static const int32_t first_bin = 4;
+static const int32_t last_bin = 128;
+
+Gate::Gate(Config config)
+    : config(config), spectrum(frame_size), power(frame_size / 2 + 1) {}
+
+// Sign changes between neighbouring samples. Branch free, so the compiler
+// vectorizes it
+static int32_t zero_crossings(const float *frame, int32_t n) {
+  int32_t crossings = 0;
+  for (int32_t i = 1; i < n; i++) {
+    crossings += (frame[i] >= 0.0f) != (frame[i - 1] >= 0.0f);
+  }
+  return crossings;
+}
+
+float Gate::score(const float *samples, int32_t n_samples) {
+  int32_t num_frames = n_samples / frame_size;
+  if (num_frames == 0) {
+    return 0.0f;
+  }
+  const float floor_energy = std::pow(10.0f, config.floor_db / 10.0f);
+  int32_t voiced = 0;
+  for (int32_t f = 0; f < num_frames; f++) {
+    const float *frame = samples + static_cast<size_t>(f) * frame_size;
+    // Mean square through the SIMD dot product
+    float energy = dsp::dot(frame, frame, frame_size) / frame_size;
+    if (energy < floor_energy) {
+      continue;
+    }
+    float zcr = static_cast<float>(zero_crossings(frame, frame_size)) /
+                (frame_size - 1);
+    if (zcr > config.max_zcr) {
+      continue;
+    }
+    spectrum.compute(frame, power.data());
+    double log_sum = 0.0;
+    double sum = 0.0;
+    for (int32_t k = first_bin; k < last_bin; k++) {
+      double value = power[k] + 1e-12;
+      log_sum += std::log(value);
+      sum += value;
+    }
+    const int32_t bins = last_bin - first_bin;
+    double flatness = std::exp(log_sum / bins) / (sum / bins);
+    if (flatness <= config.max_flatness) {
+      voiced++;
+    }
+  }
+  return static_cast<float>(voiced) / num_frames;
+}
+
+bool Gate::is_speech(const float *samples, int32_t n_samples) {
+  auto start_time = std::chrono::steady_clock::now();
+  float voiced = score(samples, n_samples);
+  bool speech = voiced >= config.threshold;
+  double seconds = n_samples / 16000.0;
+  totals.segments++;
+  totals.seconds += seconds;
+  if (!speech) {
+    totals.skipped++;
+    totals.skipped_seconds += seconds;
+    SPDLOG_DEBUG("Speech gate skipped {:.2f}s with {:.0f}% voiced frames",
+                 seconds, voiced * 100.0f);
+  }
+  totals.elapsed += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+  return speech;
+}
+
+} // namespace gate
@@ -0,0 +1,144 @@
+#include "guard.h"
+#include <algorithm>
+#include <cmath>
+
+namespace guard {
+
+void Guard::begin_chunk(whisper_full_params &params, double audio_seconds) {
+  // Retries are only denied before a chunk starts. Ending a retry early
+  // would leave whisper with its empty result instead of the earlier pass's
+  denied = !retries_left() && params.temperature_inc > 0.0f;
+  if (denied) {
+    params.temperature_inc = 0.0f;
+  }
+  chunk_start = std::chrono::steady_clock::now();
+  max_tokens = config.max_tokens_per_second > 0.0f
+                   ? config.min_tokens + static_cast<int32_t>(std::ceil(
+                                             config.max_tokens_per_second *
+                                             audio_seconds))
+                   : 0;
+  pass_tokens = 0;
+  loop = false;
+  token_cap = false;
+  retries = 0;
+  aborted = false;
+
+  params.encoder_begin_callback = on_encoder_begin;
+  params.encoder_begin_callback_user_data = this;
+  params.logits_filter_callback = on_logits;
+  params.logits_filter_callback_user_data = this;
+  if (config.chunk_timeout > 0.0f) {
+    params.abort_callback = on_abort;
+    params.abort_callback_user_data = this;
+  }
+}
+
+std::vector<std::string> Outcome::names() const {
+  std::vector<std::string> names;
+  if (loop) {
+    names.push_back("loop");
+  }
+  if (token_cap) {
+    names.push_back("token_cap");
+  }
+  if (aborted) {
+    names.push_back("aborted");
+  }
+  return names;
+}
+
+Outcome Guard::end_chunk() {
+  Outcome outcome;
+  outcome.loop = loop.load();
+  outcome.token_cap = token_cap.load();
+  outcome.aborted = aborted.load();
+  int32_t chunk_retries = retries.load();
+  totals.chunks++;
+  totals.loops += outcome.loop;
+  totals.token_caps += outcome.token_cap;
+  totals.retried += chunk_retries > 0;
+  totals.retries += chunk_retries;
+  totals.denied += denied;
+  totals.aborted += outcome.aborted;
+  return outcome;
+}
+
+bool Guard::retries_left() const {
+  return config.fallback_budget < 0 ||
+         totals.retries + retries < config.fallback_budget;
+}
+
+bool Guard::on_encoder_begin(whisper_context *ctx, whisper_state *state,
+                             void *user_data) {
+  // A new window of the chunk, its first pass isn't a retry
+  auto *guard = static_cast<Guard *>(user_data);
+  guard->pass_tokens.store(0);
+  return !guard->aborted.load();
+}
+
+bool Guard::on_abort(void *user_data) {
+  auto *guard = static_cast<Guard *>(user_data);
+  if (!guard->aborted.load()) {
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - guard->chunk_start)
+                         .count();
+    guard->aborted.store(elapsed > guard->config.chunk_timeout);
+  }
+  return guard->aborted.load();
+}
+
+bool Guard::looping(const whisper_token_data *tokens, int n_tokens) const {
+  for (int32_t n = 1; n <= config.max_ngram; n++) {
+    int32_t span = std::max(config.loop_tokens, 3 * n);
+    span = span / n * n + (span % n ? n : 0); // Whole repeats
+    if (span > n_tokens) {
+      break;
+    }
+    const whisper_token_data *tail = tokens + n_tokens - span;
+    bool repeated = true;
+    for (int32_t i = n; i < span && repeated; i++) {
+      repeated = tail[i].id == tail[i - n].id;
+    }
+    if (repeated) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Guard::on_logits(whisper_context *ctx, whisper_state *state,
+                      const whisper_token_data *tokens, int n_tokens,
+                      float *logits, void *user_data) {
+  auto *guard = static_cast<Guard *>(user_data);
+  // Decoders restart from no tokens on each hotter retry. All decoders of
+  // the retry see that on its first step, which whisper finishes before the
+  // next one, so only the decoder that resets the pass counts it
+  int32_t seen = guard->pass_tokens.load();
+  if (n_tokens == 0 && seen > 0 &&
+      guard->pass_tokens.compare_exchange_strong(seen, 0)) {
+    guard->retries++;
+  }
+  seen = guard->pass_tokens.load();
+  while (seen < n_tokens &&
+         !guard->pass_tokens.compare_exchange_weak(seen, n_tokens)) {
+  }
+
+  bool stop = false;
+  if (guard->max_tokens > 0 && n_tokens >= guard->max_tokens) {
+    guard->token_cap = true;
+    stop = true;
+  }
+  if (!stop && guard->config.max_ngram > 0 &&
+      guard->looping(tokens, n_tokens)) {
+    guard->loop = true;
+    stop = true;
+  }
+  if (stop) {
+    // Only the end of text is left to decode
+    const whisper_token eot = whisper_token_eot(ctx);
+    std::fill(logits, logits + whisper_n_vocab(ctx), -INFINITY);
+    logits[eot] = 0.0f;
+  }
+}
+
+} // namespace guard
@@ -0,0 +1,244 @@
+#include "loud.h"
+#include "channels.h"
+#include "diarization.h"
+#include "pipeline.h"
+#include <exception>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <string>
+
+struct loud_engine {
+  std::unique_ptr<pipeline::Engine> engine;
+};
+
+static std::string param_or(const char *value, const std::string &fallback) {
+  return value ? std::string(value) : fallback;
+}
+
+static segments::SegmentCallback wrap_callback(loud_segment_callback callback,
+                                               void *user_data) {
+  if (!callback) {
+    return nullptr;
+  }
+  return [callback, user_data](const nlohmann::ordered_json &item) {
+    auto text = item["text"].get<std::string>();
+    std::string speaker_name;
+    if (item.contains("speaker_name")) {
+      speaker_name = item["speaker_name"].get<std::string>();
+    }
+    loud_segment segment;
+    segment.start = item["start"].get<float>();
+    segment.end = item["end"].get<float>();
+    segment.speaker = item["speaker"].get<int32_t>();
+    segment.speaker_name =
+        speaker_name.empty() ? nullptr : speaker_name.c_str();
+    segment.text = text.c_str();
+    callback(&segment, user_data);
+  };
+}
+
+static int process(loud_engine *engine, const SherpaOnnxWave *wave,
+                   loud_segment_callback callback, void *user_data,
+                   float offset = 0.0f) {
+  nlohmann::ordered_json result;
+  return engine->engine->process(wave, result,
+                                 wrap_callback(callback, user_data), "",
+                                 offset)
+             ? 0
+             : -1;
+}
+
+loud_engine_params loud_engine_default_params(void) {
+  static const pipeline::Options defaults;
+  loud_engine_params params;
+  params.whisper_model_path = defaults.whisper_model_path.c_str();
+  params.segmentation_model_path = defaults.segmentation_model_path.c_str();
+  params.embedding_model_path = defaults.embedding_model_path.c_str();
+  params.language = defaults.language.c_str();
+  params.onnx_provider = defaults.onnx_provider.c_str();
+  params.num_speakers = defaults.num_speakers;
+  params.onnx_num_threads = defaults.onnx_num_threads;
+  params.diarization_window = defaults.diarization_window;
+  params.diarization_window_overlap = defaults.diarization_window_overlap;
+  params.diarization_workers = defaults.diarization_workers;
+  params.use_vad = defaults.use_vad;
+  params.vad_model_path = defaults.vad_model_path.c_str();
+  params.vad_threshold = defaults.vad_threshold;
+  params.speaker_db_path = nullptr;
+  params.speaker_threshold = defaults.speaker_threshold;
+  params.speaker_db_int8 = defaults.speaker_db_int8;
+  params.dynamic_audio_ctx = defaults.dynamic_audio_ctx;
+  params.shared_mel = defaults.shared_mel;
+  params.decode_guard = defaults.decode_guard;
+  params.fallback_budget = defaults.fallback_budget;
+  params.decode_timeout = defaults.decode_timeout;
+  params.diarization_input_path = nullptr;
+  params.resolve_overlaps = defaults.resolve_overlaps;
+  params.speech_gate = defaults.speech_gate;
+  params.channels_as_speakers = defaults.channels_as_speakers;
+  params.dedup_index_path = nullptr;
+  params.cpu_variant = nullptr;
+  params.deadline = defaults.deadline;
+  params.target_rtf = defaults.target_rtf;
+  params.deadline_model_path = nullptr;
+  params.refine_model_path = nullptr;
+  params.refine_logprob_threshold = defaults.refine_logprob_threshold;
+  params.refine_compression_ratio = defaults.refine_compression_ratio;
+  params.asr_backend = defaults.asr_backend.c_str();
+  params.diarization_backend = defaults.diarization_backend.c_str();
+  params.mock_asr_rtf = defaults.mock_asr_rtf;
+  params.mock_diarization_rtf = defaults.mock_diarization_rtf;
+  params.sherpa_asr_model_path = nullptr;
+  params.sherpa_asr_model_type = defaults.sherpa_asr_model_type.c_str();
+  params.asr_batch_size = defaults.asr_batch_size;
+  return params;
+}
+
+loud_engine *loud_engine_create(const loud_engine_params *params) {
+  auto defaults = loud_engine_default_params();
+  if (!params) {
+    params = &defaults;
+  }
+
+  try {
+    pipeline::Options options;
+    options.whisper_model_path =
+        param_or(params->whisper_model_path, options.whisper_model_path);
+    options.segmentation_model_path = param_or(
+        params->segmentation_model_path, options.segmentation_model_path);
+    options.embedding_model_path =
+        param_or(params->embedding_model_path, options.embedding_model_path);
+    options.language = param_or(params->language, options.language);
+    options.onnx_provider =
+        param_or(params->onnx_provider, options.onnx_provider);
+    options.num_speakers = params->num_speakers;
+    options.onnx_num_threads = params->onnx_num_threads;
+    options.diarization_window = params->diarization_window;
+    options.diarization_window_overlap = params->diarization_window_overlap;
+    options.diarization_workers = params->diarization_workers;
+    options.use_vad = params->use_vad != 0;
+    options.vad_model_path =
+        param_or(params->vad_model_path, options.vad_model_path);
+    options.vad_threshold = params->vad_threshold;
+    options.speaker_db_path = param_or(params->speaker_db_path, "");
+    options.speaker_threshold = params->speaker_threshold;
+    options.speaker_db_int8 = params->speaker_db_int8 != 0;
+    options.dynamic_audio_ctx = params->dynamic_audio_ctx != 0;
+    options.shared_mel = params->shared_mel != 0;
+    options.decode_guard = params->decode_guard != 0;
+    options.fallback_budget = params->fallback_budget;
+    options.decode_timeout = params->decode_timeout;
+    options.channels_as_speakers = params->channels_as_speakers != 0;
+    options.dedup_index_path = param_or(params->dedup_index_path, "");
+    options.diarization_input_path =
+        param_or(params->diarization_input_path, "");
+    options.resolve_overlaps = params->resolve_overlaps != 0;
+    options.speech_gate = params->speech_gate;
+    options.cpu_variant = param_or(params->cpu_variant, "");
+    options.deadline = params->deadline;
+    options.target_rtf = params->target_rtf;
+    options.deadline_model_path = param_or(params->deadline_model_path, "");
+    options.refine_model_path = param_or(params->refine_model_path, "");
+    options.refine_logprob_threshold = params->refine_logprob_threshold;
+    options.refine_compression_ratio = params->refine_compression_ratio;
+    options.asr_backend = param_or(params->asr_backend, options.asr_backend);
+    options.diarization_backend =
+        param_or(params->diarization_backend, options.diarization_backend);
+    options.mock_asr_rtf = params->mock_asr_rtf;
+    options.mock_diarization_rtf = params->mock_diarization_rtf;
+    options.sherpa_asr_model_path = param_or(params->sherpa_asr_model_path, "");
+    options.sherpa_asr_model_type =
+        param_or(params->sherpa_asr_model_type, options.sherpa_asr_model_type);
+    options.asr_batch_size = params->asr_batch_size;
+
+    auto engine = std::make_unique<loud_engine>();
+    engine->engine = std::make_unique<pipeline::Engine>(std::move(options));
+    if (!engine->engine->load()) {
+      return nullptr;
+    }
+    return engine.release();
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Failed to create engine: {}", e.what());
+    return nullptr;
+  }
+}
+
+void loud_engine_free(loud_engine *engine) { delete engine; }
+
+int loud_engine_process_pcm(loud_engine *engine, const float *samples,
+                            int32_t n_samples, loud_segment_callback callback,
+                            void *user_data) {
+  if (!engine || (!samples && n_samples > 0) || n_samples < 0) {
+    return -1;
+  }
+  SherpaOnnxWave wave;
+  wave.samples = samples;
+  wave.sample_rate = 16000;
+  wave.num_samples = n_samples;
+
+  try {
+    return process(engine, &wave, callback, user_data);
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Failed to process audio: {}", e.what());
+    return -1;
+  }
+}
+
+int loud_engine_process_channels(loud_engine *engine,
+                                 const float *const *channels,
+                                 int32_t n_channels, int32_t n_samples,
+                                 loud_segment_callback callback,
+                                 void *user_data) {
+  if (!engine || !channels || n_channels <= 0 || n_samples < 0) {
+    return -1;
+  }
+
+  try {
+    channels::MultiChannelAudio audio;
+    audio.sample_rate = 16000;
+    for (int32_t c = 0; c < n_channels; c++) {
+      audio.channels.emplace_back(channels[c], channels[c] + n_samples);
+    }
+    nlohmann::ordered_json result;
+    return engine->engine->process_channels(
+               audio, result, wrap_callback(callback, user_data))
+               ? 0
+               : -1;
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Failed to process channels: {}", e.what());
+    return -1;
+  }
+}
+
+int loud_engine_process_file(loud_engine *engine, const char *path,
+                             loud_segment_callback callback, void *user_data) {
+  return loud_engine_process_file_range(engine, path, 0.0f, 0.0f, callback,
+                                        user_data);
+}
+
+int loud_engine_process_file_range(loud_engine *engine, const char *path,
+                                   float start, float end,
+                                   loud_segment_callback callback,
+                                   void *user_data) {
+  if (!engine || !path || start < 0.0f || (end > 0.0f && end <= start)) {
+    return -1;
+  }
+  try {
+    if (engine->engine->options().channels_as_speakers) {
+      auto audio = channels::prepare_audio_file(path, 0, nullptr, start, end);
+      nlohmann::ordered_json result;
+      return audio && engine->engine->process_channels(
+                          *audio, result, wrap_callback(callback, user_data))
+                 ? 0
+                 : -1;
+    }
+    auto audio = diarization::prepare_audio_file(path, 0, nullptr, start, end);
+    if (!audio) {
+      return -1;
+    }
+    return process(engine, audio->wave(), callback, user_data, audio->offset);
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Failed to process {}: {}", path, e.what());
+    return -1;
+  }
+}
@@ -1,19 +1,23 @@
 // enable SPDLOG macros
+#include <chrono>
 #include <cstdlib>
 #include <string>
 #define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
 
 #include "CLI/CLI.hpp"
+#include "channels.h"
 #include "config.h"
 #include "diarization.h"
 #include "download.h"
-#include "segments.h"
+#include "pipeline.h"
 #include "sherpa-onnx/c-api/c-api.h"
 #include "spdlog/cfg/env.h"
 #include "spdlog/common.h"
 #include "spdlog/spdlog.h"
-#include "spinner.h"
-#include "transcribe.h"
+#include "progress.h"
+#include "rttm.h"
+#include "shard.h"
+#include "transcript.h"
 #include <CLI/CLI.hpp>
 #include <fmt/color.h>
 #include <fmt/core.h>
@@ -22,11 +26,9 @@
 #include <termcolor/termcolor.hpp>
 
 #include "utils.h"
-#include <whisper.h>
 
 namespace fs = std::filesystem;
 
-using spinner::Spinner;
 using utils::contains;
 
 int main(int argc, char *argv[]) {
@@ -37,12 +39,58 @@ int main(int argc, char *argv[]) {
   std::string whisper_model_path = config::ggml_tiny_name;
   std::string audio_file;
   std::string json_path;
+  std::string transcript_path;
   std::string segmentation_model_path = config::segmentation_name;
   std::string embedding_model_path = config::embedding_name;
   std::string language = "en";
   int32_t num_speakers = 4;
   int32_t onnx_num_threads = 4;
   std::string onnx_provider = diarization::get_default_provider();
+  float diarization_window = 0.0f;
+  float diarization_window_overlap = 30.0f;
+  int32_t diarization_workers = 0;
+  bool use_vad = false;
+  std::string vad_model_path = config::vad_name;
+  float vad_threshold = 0.5f;
+  std::string speaker_db_path;
+  std::string enroll_name;
+  float speaker_threshold = 0.6f;
+  bool speaker_db_int8 = false;
+  bool dynamic_audio_ctx = false;
+  bool shared_mel = false;
+  bool decode_guard = false;
+  int32_t fallback_budget = -1;
+  float decode_timeout = 0.0f;
+  float speech_gate = 0.0f;
+  bool channels_as_speakers = false;
+  std::string diarization_input_path;
+  bool diarization_only = false;
+  bool resolve_overlaps = false;
+  std::string rttm_path;
+  std::string centroids_path;
+  std::string shard_dir;
+  float shard_seconds = 1800.0f;
+  float shard_margin = 60.0f;
+  std::string manifest_path;
+  float link_threshold = 0.5f;
+  std::string dedup_index_path;
+  float deadline = 0.0f;
+  float target_rtf = 0.0f;
+  std::string deadline_model_path;
+  std::string refine_model_path;
+  std::string asr_backend = "whisper";
+  std::string diarization_backend = "sherpa";
+  float mock_asr_rtf = 0.05f;
+  float mock_diarization_rtf = 0.02f;
+  std::string sherpa_asr_model_path;
+  std::string sherpa_asr_model_type = "sense_voice";
+  int32_t asr_batch_size = 16;
+  float refine_logprob_threshold = -1.0f;
+  float refine_compression_ratio = 2.4f;
+  float range_start = 0.0f;
+  float range_end = 0.0f;
+  int progress_fd = -1;
+  std::string cpu_variant;
   bool setup = false;
   bool show_version = false;
 
@@ -50,17 +98,68 @@ int main(int argc, char *argv[]) {
   auto audio_flag =
       app.add_option("audio", audio_file, "Path to the audio file")
           ->check(CLI::ExistingFile);
-  if (!contains(argc, argv, "--version") && !contains(argc, argv, "-v")) {
+  bool subcommand = argc > 1 && (std::string(argv[1]) == "shard" ||
+                                 std::string(argv[1]) == "merge");
+  if (!contains(argc, argv, "--version") && !contains(argc, argv, "-v") &&
+      !subcommand) {
     audio_flag->required();
   }
 
+  // Split a long recording across machines, then merge their results
+  auto *shard_cmd = app.add_subcommand(
+      "shard", "Cut the audio into overlapping 16kHz wav shards and a "
+               "shards.json manifest, to process on several machines with "
+               "--centroids and stitch with loud merge");
+  shard_cmd->add_option("audio", audio_file, "Path to the audio file")
+      ->required()
+      ->check(CLI::ExistingFile);
+  shard_cmd->add_option("--out-dir", shard_dir, "Directory of the shards")
+      ->required();
+  shard_cmd->add_option("--shard-seconds", shard_seconds,
+                        "Length of each shard (Default: 1800)")
+      ->check(CLI::PositiveNumber);
+  shard_cmd->add_option("--margin", shard_margin,
+                        "Seconds each shard overlaps its neighbours on each "
+                        "side, longer than the longest turn (Default: 60)")
+      ->check(CLI::NonNegativeNumber);
+  auto *merge_cmd = app.add_subcommand(
+      "merge", "Stitch the results of the shards in a shards.json manifest "
+               "into one result, relinking speakers across shards");
+  merge_cmd->add_option("manifest", manifest_path, "Path to shards.json")
+      ->required()
+      ->check(CLI::ExistingFile);
+  merge_cmd->add_option("--json", json_path, "Path to save the JSON output");
+  merge_cmd->add_option("--transcript", transcript_path,
+                        "Path to save a compact binary transcript");
+  merge_cmd->add_option("--num-speakers", num_speakers,
+                        "Most speakers to link across shards (Default: 4)");
+  merge_cmd->add_option("--link-threshold", link_threshold,
+                        "Minimum centroid similarity to link speakers of "
+                        "different shards (Default: 0.5)");
+
+  app.add_option("--start", range_start,
+                 "Only process the audio from this many seconds on, "
+                 "timestamps stay in file time (Default: 0)")
+      ->check(CLI::NonNegativeNumber);
+  app.add_option("--end", range_end,
+                 "Only process the audio up to this many seconds (Default: "
+                 "0, end of file)")
+      ->check(CLI::NonNegativeNumber);
   app.add_option("--language", language,
                  "Language to transcribe with (Default: en)");
   app.add_flag("--setup", setup,
                "Download models (pyannote segment, whisper tiny, nemo small "
-               "en) and FFMPEG if not found");
+               "en, silero vad) and FFMPEG if not found");
   app.add_flag("--version,-v", show_version, "Show loud.cpp version and exit");
   app.add_option("--json", json_path, "Path to save the JSON output");
+  app.add_option("--transcript", transcript_path,
+                 "Path to save a compact binary transcript with a time "
+                 "index, see loud-transcript");
+  app.add_option("--rttm", rttm_path,
+                 "Path to save the speaker turns as an RTTM file");
+  app.add_option("--centroids", centroids_path,
+                 "Path to save each speaker's embedding centroid, for loud "
+                 "merge");
   app.add_option("--whisper-model", whisper_model_path, "Path to the model");
   app.add_option("--segmentation-model", segmentation_model_path,
                  "Path to the segmentation model");
@@ -72,12 +171,200 @@ int main(int argc, char *argv[]) {
   app.add_option("--onnx-num-threads", onnx_num_threads,
                  "Onnx number of threads (Default: 4)");
 
+  app.add_option("--diarization-window", diarization_window,
+                 "Diarize audio longer than this many seconds in parallel "
+                 "windows (Default: 0, disabled)");
+  app.add_option("--diarization-window-overlap", diarization_window_overlap,
+                 "Overlap between diarization windows in seconds (Default: "
+                 "30)");
+  app.add_option("--diarization-workers", diarization_workers,
+                 "Number of parallel diarization windows, they share "
+                 "--onnx-num-threads (Default: number of cores)");
+
+  app.add_flag("--vad", use_vad,
+               "Drop silence with voice activity detection before "
+               "diarization and transcription");
+  app.add_option("--vad-model", vad_model_path, "Path to the silero vad model");
+  app.add_option("--vad-threshold", vad_threshold,
+                 "Speech probability threshold of the vad (Default: 0.5)");
+
+  app.add_option("--speaker-db", speaker_db_path,
+                 "Path to the enrolled speakers index used to name speakers");
+  app.add_option("--enroll", enroll_name,
+                 "Enroll the audio file as this speaker into --speaker-db "
+                 "and exit");
+  app.add_option("--speaker-threshold", speaker_threshold,
+                 "Minimum similarity to name a speaker (Default: 0.6)");
+  app.add_flag("--speaker-db-int8", speaker_db_int8,
+               "Search the speaker index with int8 embeddings (faster for "
+               "large rosters)");
+
+  app.add_flag("--dynamic-audio-ctx", dynamic_audio_ctx,
+               "Size whisper's audio context to each segment instead of "
+               "padding to 30s (faster, may reduce accuracy)");
+  app.add_flag("--shared-mel", shared_mel,
+               "Compute whisper's log mel spectrogram of the audio once "
+               "instead of once per segment (faster with many short "
+               "segments)");
+  app.add_flag("--decode-guard", decode_guard,
+               "End whisper decodes early on repetition loops and on more "
+               "tokens than the audio can hold");
+  app.add_option("--fallback-budget", fallback_budget,
+                 "Temperature fallback retries allowed per file (Default: "
+                 "-1, no limit)");
+  app.add_option("--decode-timeout", decode_timeout,
+                 "Abort a segment's decode after this many seconds "
+                 "(Default: 0, no limit)");
+  app.add_option("--speech-gate", speech_gate,
+                 "Skip segments with fewer voiced frames than this fraction, "
+                 "eg. 0.1 for breaths, clicks and line noise (Default: 0, "
+                 "disabled)")
+      ->check(CLI::Range(0.0f, 1.0f));
+
+  app.add_option("--asr-backend", asr_backend,
+                 "Speech to text backend, sherpa runs a sherpa-onnx offline "
+                 "model on batches of segments, mock sleeps instead of "
+                 "running a model (Default: whisper)")
+      ->check(CLI::IsMember({"whisper", "sherpa", "mock"}));
+  app.add_option("--sherpa-asr-model", sherpa_asr_model_path,
+                 "Directory of the sherpa-onnx offline model and its "
+                 "tokens.txt for --asr-backend sherpa");
+  app.add_option("--sherpa-asr-model-type", sherpa_asr_model_type,
+                 "Type of the sherpa-onnx offline model (Default: "
+                 "sense_voice)")
+      ->check(CLI::IsMember({"sense_voice", "paraformer", "moonshine",
+                             "whisper"}));
+  app.add_option("--asr-batch-size", asr_batch_size,
+                 "Segments decoded per call by the sherpa asr backend "
+                 "(Default: 16)");
+  app.add_option("--diarization-backend", diarization_backend,
+                 "Diarization backend, mock sleeps instead of running a "
+                 "model (Default: sherpa)")
+      ->check(CLI::IsMember({"sherpa", "mock"}));
+  app.add_option("--mock-asr-rtf", mock_asr_rtf,
+                 "Real time factor of the mock asr backend (Default: 0.05)");
+  app.add_option("--mock-diarization-rtf", mock_diarization_rtf,
+                 "Real time factor of the mock diarization backend (Default: "
+                 "0.02)");
+
+  app.add_option("--refine-model", refine_model_path,
+                 "Larger whisper model to re-transcribe segments that "
+                 "--whisper-model is unsure of (a model directory with "
+                 "--asr-backend sherpa)");
+  app.add_option("--refine-logprob-threshold", refine_logprob_threshold,
+                 "Refine segments with a lower mean token log probability "
+                 "(Default: -1.0)");
+  app.add_option("--refine-compression-ratio", refine_compression_ratio,
+                 "Refine segments with a higher compression ratio, a sign "
+                 "of repetition (Default: 2.4)");
+
+  app.add_option("--deadline", deadline,
+                 "Finish within this many seconds of starting, audio "
+                 "decoding and model loading included, making transcription "
+                 "cheaper when behind (Default: 0, disabled)");
+  app.add_option("--target-rtf", target_rtf,
+                 "Finish within this multiple of the audio duration, counted "
+                 "like --deadline, eg. 0.3 (Default: 0, disabled)");
+  app.add_option("--deadline-model", deadline_model_path,
+                 "Smaller or quantized whisper model to switch to when far "
+                 "behind the deadline (a model directory with --asr-backend "
+                 "sherpa)");
+
+  app.add_option("--dedup-index", dedup_index_path,
+                 "Path to a fingerprint index used to reuse transcripts of "
+                 "repeated audio (eg. IVR prompts) across files");
+
+  app.add_flag("--channels-as-speakers", channels_as_speakers,
+               "Treat each audio channel as one speaker and skip "
+               "diarization (eg. stereo call recordings)");
+  app.add_option("--diarization-input", diarization_input_path,
+                 "RTTM file of the audio's speaker turns to transcribe "
+                 "instead of diarizing (eg. from a telephony platform or a "
+                 "--diarization-only run)")
+      ->check(CLI::ExistingFile);
+  app.add_flag("--diarization-only", diarization_only,
+               "Only diarize into --rttm, without loading the whisper "
+               "model");
+  app.add_flag("--resolve-overlaps", resolve_overlaps,
+               "Transcribe the audio of overlapping speaker turns once and "
+               "mark it as overlapped speech, instead of once per speaker");
+
+  app.add_option("--cpu-variant", cpu_variant,
+                 "Use this ggml CPU kernel variant (eg. haswell) instead of "
+                 "the best one for this CPU, for benchmarking");
+
+  app.add_option("--progress-fd", progress_fd,
+                 "Write progress as JSON lines to this file descriptor "
+                 "instead of showing a spinner");
+
   try {
     app.parse(argc, argv);
   } catch (const CLI::ParseError &e) {
     return app.exit(e);
   }
 
+  progress::init(progress::detect_mode(progress_fd), progress_fd);
+
+  if (*shard_cmd) {
+    // Also rejects NaN, which gets past the option checks
+    if (!(shard_seconds > 0.0f) || !(shard_margin >= 0.0f)) {
+      std::cerr << termcolor::red << "✗" << termcolor::reset
+                << " --shard-seconds must be positive and --margin can't be "
+                   "negative"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    auto audio = diarization::prepare_audio_file(audio_file, argc, argv);
+    if (!audio) {
+      return EXIT_FAILURE;
+    }
+    const auto *wave = audio->wave();
+    auto manifest = shard::plan(audio_file, wave->num_samples / 16000.0f,
+                                shard_seconds, shard_margin);
+    if (!shard::write(wave, shard_dir, manifest)) {
+      return EXIT_FAILURE;
+    }
+    std::cout << termcolor::green << "✓" << termcolor::reset << " Wrote "
+              << manifest.shards.size() << " shards to " << shard_dir
+              << ", process each with:" << std::endl;
+    for (const auto &shard : manifest.shards) {
+      auto in_dir = [&](const std::string &name) {
+        return (fs::path(shard_dir) / name).string();
+      };
+      std::cout << "  loud " << in_dir(shard.audio) << " --json "
+                << in_dir(shard.json) << " --centroids "
+                << in_dir(shard.centroids) << std::endl;
+    }
+    std::cout << "then: loud merge "
+              << (fs::path(shard_dir) / "shards.json").string()
+              << " --json result.json" << std::endl;
+    progress::shutdown();
+    return EXIT_SUCCESS;
+  }
+  if (*merge_cmd) {
+    nlohmann::ordered_json merged;
+    if (!shard::merge_files(manifest_path, link_threshold, num_speakers,
+                            merged)) {
+      return EXIT_FAILURE;
+    }
+    if (!transcript_path.empty() &&
+        !transcript::save(transcript_path, merged)) {
+      SPDLOG_ERROR("Failed to save transcript {}", transcript_path);
+    }
+    if (!json_path.empty()) {
+      utils::save_json(json_path, merged);
+    }
+    std::cout << termcolor::green << "✓" << termcolor::reset << " Merged "
+              << merged.size() << " segments" << std::endl;
+    progress::shutdown();
+    return EXIT_SUCCESS;
+  }
+
+  if (range_end > 0.0f && range_end <= range_start) {
+    SPDLOG_ERROR("--end must be after --start");
+    return EXIT_FAILURE;
+  }
+
   if (show_version) {
     if (TAG[0] == '\0' || REV[0] == '\0') {
       SPDLOG_ERROR("TAG and REV was not set");
@@ -93,17 +380,54 @@ int main(int argc, char *argv[]) {
   }
 
   // Download models
-  if (setup) {
-    download::download_resources_if_needed();
+  if (setup && !download::download_resources_if_needed()) {
+    std::cerr << termcolor::red << "✗" << termcolor::reset
+              << " Failed to download the models" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bool given_turns = !diarization_input_path.empty();
+  if (diarization_only && (rttm_path.empty() || given_turns)) {
+    std::cerr << termcolor::red << "✗" << termcolor::reset
+              << " --diarization-only needs --rttm and no --diarization-input"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (channels_as_speakers &&
+      (given_turns || !rttm_path.empty() || !centroids_path.empty())) {
+    std::cerr << termcolor::red << "✗" << termcolor::reset
+              << " --channels-as-speakers has no speaker turns for RTTM "
+                 "files or --centroids"
+              << std::endl;
+    return EXIT_FAILURE;
   }
 
-  // Check if models exists
-  if (!utils::check_resource_exists(embedding_model_path, argc, argv))
+  // Check if models exists, mock backends don't need them
+  bool sherpa_diarization = !channels_as_speakers && !given_turns &&
+                            diarization_backend == "sherpa";
+  bool whisper_asr = !diarization_only && asr_backend == "whisper";
+  bool model_centroids =
+      !centroids_path.empty() && diarization_backend != "mock";
+  if ((sherpa_diarization || !speaker_db_path.empty() || model_centroids) &&
+      !utils::check_resource_exists(embedding_model_path, argc, argv))
     return EXIT_FAILURE;
-  if (!utils::check_resource_exists(segmentation_model_path, argc, argv))
+  if (sherpa_diarization &&
+      !utils::check_resource_exists(segmentation_model_path, argc, argv))
     return EXIT_FAILURE;
-  if (!utils::check_resource_exists(whisper_model_path, argc, argv))
+  if (whisper_asr &&
+      !utils::check_resource_exists(whisper_model_path, argc, argv))
     return EXIT_FAILURE;
+  if (whisper_asr && !refine_model_path.empty() &&
+      !utils::check_resource_exists(refine_model_path, argc, argv))
+    return EXIT_FAILURE;
+  if (!diarization_only && asr_backend == "sherpa" &&
+      !fs::is_directory(sherpa_asr_model_path)) {
+    std::cerr << termcolor::red << "✗" << termcolor::reset
+              << " --asr-backend sherpa needs a model directory in "
+                 "--sherpa-asr-model"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
 
   // Check if it's not wav file. then suggest download FFMPEG
   if (fs::path(audio_file).extension().string() != ".wav") {
@@ -112,44 +436,150 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // Read wave file
-  auto wave = diarization::prepare_audio_file(audio_file, argc, argv);
-  if (!wave)
+  pipeline::Options options;
+  options.whisper_model_path = whisper_model_path;
+  options.segmentation_model_path = segmentation_model_path;
+  options.embedding_model_path = embedding_model_path;
+  options.language = language;
+  options.onnx_provider = onnx_provider;
+  options.num_speakers = num_speakers;
+  options.onnx_num_threads = onnx_num_threads;
+  options.diarization_window = diarization_window;
+  options.diarization_window_overlap = diarization_window_overlap;
+  options.diarization_workers = diarization_workers;
+  options.use_vad = use_vad;
+  options.vad_model_path = vad_model_path;
+  options.vad_threshold = vad_threshold;
+  options.speaker_db_path = speaker_db_path;
+  options.speaker_threshold = speaker_threshold;
+  options.speaker_db_int8 = speaker_db_int8;
+  options.dynamic_audio_ctx = dynamic_audio_ctx;
+  options.shared_mel = shared_mel;
+  options.decode_guard = decode_guard;
+  options.fallback_budget = fallback_budget;
+  options.decode_timeout = decode_timeout;
+  options.speech_gate = speech_gate;
+  options.channels_as_speakers = channels_as_speakers;
+  options.diarization_input_path = diarization_input_path;
+  options.diarization_only = diarization_only;
+  options.resolve_overlaps = resolve_overlaps;
+  options.dedup_index_path = dedup_index_path;
+  options.deadline = deadline;
+  options.target_rtf = target_rtf;
+  options.deadline_model_path = deadline_model_path;
+  options.refine_model_path = refine_model_path;
+  options.asr_backend = asr_backend;
+  options.diarization_backend = diarization_backend;
+  options.mock_asr_rtf = mock_asr_rtf;
+  options.mock_diarization_rtf = mock_diarization_rtf;
+  options.sherpa_asr_model_path = sherpa_asr_model_path;
+  options.sherpa_asr_model_type = sherpa_asr_model_type;
+  options.asr_batch_size = asr_batch_size;
+  options.refine_logprob_threshold = refine_logprob_threshold;
+  options.refine_compression_ratio = refine_compression_ratio;
+  options.cpu_variant = cpu_variant;
+  options.print_status = true;
+
+  if (use_vad && !utils::check_resource_exists(vad_model_path, argc, argv))
     return EXIT_FAILURE;
 
-  // Start diarization
-  Spinner spinner("Starting diarization...");
-  auto *sd =
-      diarization::create_sd(segmentation_model_path, embedding_model_path,
-                             num_speakers, onnx_provider, onnx_num_threads);
-  CHECK_NULL(sd);
-  spinner.start();
-  const auto segments =
-      diarization::run_diarization(argc, argv, sd, wave, spinner);
-  spinner.stop();
-  std::cout << termcolor::green << "✓" << termcolor::reset
-            << " Diarization complete!" << std::endl;
-  SherpaOnnxDestroyOfflineSpeakerDiarization(sd);
-
-  // Start transcribe
-  const auto params = transcribe::create_whisper_params(language);
-  const auto cparams = whisper_context_default_params();
-  auto *ctx =
-      whisper_init_from_file_with_params(whisper_model_path.c_str(), cparams);
-  CHECK_NULL(ctx);
-
-  std::cout << "Starting parse segments!" << std::endl;
-  auto json = segments::process_segments(segments, wave, ctx, params);
+  // Deadlines count from here, before the audio is decoded
+  auto started = std::chrono::steady_clock::now();
+  pipeline::Engine engine(options);
+  nlohmann::ordered_json json;
+  auto print = [](const nlohmann::ordered_json &item) {
+    diarization::DiarizationSegment segment{item["start"].get<float>(),
+                                            item["end"].get<float>(),
+                                            item["speaker"].get<int32_t>()};
+    diarization::print_segment(segment, item["text"].get<std::string>());
+  };
+
+  if (channels_as_speakers && enroll_name.empty()) {
+    // Read channels apart instead of the mono downmix
+    auto audio = channels::prepare_audio_file(audio_file, argc, argv,
+                                              range_start, range_end);
+    if (!audio)
+      return EXIT_FAILURE;
+    if (!engine.process_channels(*audio, json, print, started)) {
+      return EXIT_FAILURE;
+    }
+  } else {
+    // Read wave file
+    auto audio = diarization::prepare_audio_file(audio_file, argc, argv,
+                                                 range_start, range_end);
+    if (!audio)
+      return EXIT_FAILURE;
+    const auto *wave = audio->wave();
+
+    if (!enroll_name.empty()) {
+      if (speaker_db_path.empty()) {
+        SPDLOG_ERROR("--enroll requires --speaker-db");
+        return EXIT_FAILURE;
+      }
+      if (!engine.enroll(wave, enroll_name)) {
+        return EXIT_FAILURE;
+      }
+      std::cout << termcolor::green << "✓" << termcolor::reset << " Enrolled "
+                << enroll_name << " (" << engine.speaker_index().size()
+                << " speakers in " << speaker_db_path << ")" << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    std::string file_id = fs::path(audio_file).stem().string();
+    std::vector<diarization::DiarizationSegment> turns;
+    std::map<int32_t, std::string> names;
+    if (diarization_only) {
+      if (!engine.diarize(wave, turns, names,
+                          diarization::generate_cache_key(argc, argv),
+                          audio->offset) ||
+          !rttm::save(rttm_path, file_id, turns, names)) {
+        return EXIT_FAILURE;
+      }
+      std::cout << termcolor::green << "✓" << termcolor::reset << " Saved "
+                << turns.size() << " speaker turns to " << rttm_path
+                << std::endl;
+      progress::shutdown();
+      return EXIT_SUCCESS;
+    }
+
+    bool want_turns = !rttm_path.empty() || !centroids_path.empty();
+    if (!engine.process(wave, json, print,
+                        diarization::generate_cache_key(argc, argv),
+                        audio->offset, want_turns ? &turns : nullptr,
+                        started)) {
+      return EXIT_FAILURE;
+    }
+    if (!centroids_path.empty() &&
+        !shard::save_centroids(
+            centroids_path,
+            engine.speaker_centroids(wave, turns, audio->offset))) {
+      SPDLOG_ERROR("Failed to save centroids {}", centroids_path);
+    }
+    if (!rttm_path.empty()) {
+      for (const auto &item : json) {
+        if (item.contains("speaker_name")) {
+          names[item["speaker"].get<int32_t>()] =
+              item["speaker_name"].get<std::string>();
+        }
+      }
+      if (!rttm::save(rttm_path, file_id, turns, names)) {
+        SPDLOG_ERROR("Failed to save RTTM {}", rttm_path);
+      }
+    }
+  }
+
   // Write JSON file
+  if (!transcript_path.empty() && !transcript::save(transcript_path, json)) {
+    SPDLOG_ERROR("Failed to save transcript {}", transcript_path);
+  }
   if (!json_path.empty()) {
     utils::save_json(json_path, json);
-  } else {
+  } else if (transcript_path.empty()) {
     std::cout << termcolor::red << "x" << termcolor::reset << " No JSON result!"
               << std::endl;
   }
 
   // Cleanup
-  SherpaOnnxFreeWave(wave);
-  whisper_free(ctx);
+  progress::shutdown();
   return 0;
-}
\ No newline at end of file
+}
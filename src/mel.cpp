@@ -0,0 +1,219 @@
+#include "mel.h"
+#include "dsp.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <thread>
+
+namespace mel {
+
+// Log10 of zero power, what silence comes out as
+static const float silence = -10.0f;
+
+// Slaney's mel scale, linear below 1kHz and logarithmic above
+static double hz_to_mel(double hz) {
+  const double min_log_hz = 1000.0;
+  const double min_log_mel = min_log_hz * 3.0 / 200.0;
+  const double log_step = std::log(6.4) / 27.0;
+  if (hz < min_log_hz) {
+    return hz * 3.0 / 200.0;
+  }
+  return min_log_mel + std::log(hz / min_log_hz) / log_step;
+}
+
+static double mel_to_hz(double mel) {
+  const double min_log_hz = 1000.0;
+  const double min_log_mel = min_log_hz * 3.0 / 200.0;
+  const double log_step = std::log(6.4) / 27.0;
+  if (mel < min_log_mel) {
+    return mel * 200.0 / 3.0;
+  }
+  return min_log_hz * std::exp(log_step * (mel - min_log_mel));
+}
+
+std::vector<float> slaney_filters(int32_t n_mel) {
+  const int32_t bins = n_fft / 2 + 1;
+  std::vector<double> edges(n_mel + 2);
+  double max_mel = hz_to_mel(8000.0);
+  for (int32_t m = 0; m < n_mel + 2; m++) {
+    edges[m] = mel_to_hz(max_mel * m / (n_mel + 1));
+  }
+
+  std::vector<float> filters(static_cast<size_t>(n_mel) * bins, 0.0f);
+  for (int32_t m = 0; m < n_mel; m++) {
+    // Triangles normalized to the same area
+    double norm = 2.0 / (edges[m + 2] - edges[m]);
+    for (int32_t k = 0; k < bins; k++) {
+      double hz = 8000.0 * k / (bins - 1);
+      double lower = (hz - edges[m]) / (edges[m + 1] - edges[m]);
+      double upper = (edges[m + 2] - hz) / (edges[m + 2] - edges[m + 1]);
+      double weight = std::max(0.0, std::min(lower, upper));
+      filters[m * bins + k] = static_cast<float>(weight * norm);
+    }
+  }
+  return filters;
+}
+
+bool load_filters(const std::string &model_path, int32_t n_mel,
+                  std::vector<float> &filters) {
+  std::ifstream ifs(model_path, std::ios::binary);
+  // Magic, then 11 hyperparameters ending with n_mels and ftype
+  uint32_t magic = 0;
+  int32_t hparams[11];
+  ifs.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  ifs.read(reinterpret_cast<char *>(hparams), sizeof(hparams));
+  if (!ifs || magic != 0x67676d6c) {
+    return false;
+  }
+  // The filter bank follows as n_mel, bins and the weights
+  int32_t file_mel = 0;
+  int32_t file_bins = 0;
+  ifs.read(reinterpret_cast<char *>(&file_mel), sizeof(file_mel));
+  ifs.read(reinterpret_cast<char *>(&file_bins), sizeof(file_bins));
+  if (!ifs || file_mel != n_mel || file_bins != n_fft / 2 + 1) {
+    return false;
+  }
+  std::vector<float> loaded(static_cast<size_t>(n_mel) * file_bins);
+  ifs.read(reinterpret_cast<char *>(loaded.data()),
+           loaded.size() * sizeof(float));
+  if (!ifs) {
+    return false;
+  }
+  filters = std::move(loaded);
+  return true;
+}
+
+// Bins of each filter's triangle, the other weights are zero
+static std::vector<std::pair<int32_t, int32_t>>
+filter_ranges(const std::vector<float> &filters, int32_t n_mel) {
+  const int32_t bins = n_fft / 2 + 1;
+  std::vector<std::pair<int32_t, int32_t>> ranges(n_mel, {0, 0});
+  for (int32_t m = 0; m < n_mel; m++) {
+    const float *filter = filters.data() + m * bins;
+    int32_t begin = 0;
+    int32_t end = bins;
+    while (begin < bins && filter[begin] == 0.0f) {
+      begin++;
+    }
+    while (end > begin && filter[end - 1] == 0.0f) {
+      end--;
+    }
+    ranges[m] = {begin, end};
+  }
+  return ranges;
+}
+
+// Scratch space of a thread computing frames
+struct FrameState {
+  dsp::PowerSpectrum spectrum{n_fft};
+  std::vector<float> frame = std::vector<float>(n_fft);
+  std::vector<float> power = std::vector<float>(n_fft / 2 + 1);
+};
+
+// Log10 mel power of the frame centred at sample index * hop_length. Like
+// whisper pads, the audio is reflected before its start and zero after its
+// end
+static void
+compute_frame(const float *samples, int32_t n_samples, int32_t index,
+              const std::vector<float> &filters,
+              const std::vector<std::pair<int32_t, int32_t>> &ranges,
+              FrameState &state, float *out) {
+  int32_t begin = index * hop_length - n_fft / 2;
+  if (begin >= 0 && begin + n_fft <= n_samples) {
+    std::copy(samples + begin, samples + begin + n_fft, state.frame.begin());
+  } else {
+    for (int32_t j = 0; j < n_fft; j++) {
+      int32_t i = begin + j;
+      state.frame[j] = i < 0 ? samples[std::min(-i, n_samples - 1)]
+                             : (i < n_samples ? samples[i] : 0.0f);
+    }
+  }
+  state.spectrum.compute(state.frame.data(), state.power.data());
+  const auto bins = static_cast<int32_t>(state.power.size());
+  for (size_t m = 0; m < ranges.size(); m++) {
+    const float *filter = filters.data() + m * bins;
+    double sum = 0.0;
+    for (int32_t k = ranges[m].first; k < ranges[m].second; k++) {
+      sum += filter[k] * state.power[k];
+    }
+    out[m] = static_cast<float>(std::log10(std::max(sum, 1e-10)));
+  }
+}
+
+Spectrogram::Spectrogram(const float *samples, int32_t n_samples,
+                         int32_t n_mel, int32_t num_threads,
+                         std::vector<float> model_filters)
+    : samples(samples), mels(n_mel), frames(1 + n_samples / hop_length),
+      filters(model_filters.empty() ? slaney_filters(n_mel)
+                                    : std::move(model_filters)),
+      ranges(filter_ranges(filters, n_mel)) {
+  data.resize(static_cast<size_t>(frames) * mels);
+
+  auto compute = [&](int32_t first, int32_t last) {
+    FrameState state;
+    for (int32_t f = first; f < last; f++) {
+      compute_frame(samples, n_samples, f, filters, ranges, state,
+                    data.data() + static_cast<size_t>(f) * mels);
+    }
+  };
+
+  int32_t workers = std::max(1, std::min(num_threads, frames / 1000));
+  std::vector<std::thread> threads;
+  int32_t per_worker = (frames + workers - 1) / workers;
+  for (int32_t w = 1; w < workers; w++) {
+    threads.emplace_back(compute, w * per_worker,
+                         std::min(frames, (w + 1) * per_worker));
+  }
+  compute(0, std::min(frames, per_worker));
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void Spectrogram::slice(int32_t start_sample, int32_t end_sample,
+                        int32_t num_frames, std::vector<float> &out) {
+  // Frames overlapping the chunk, the nearest file frames to whisper's
+  const float *chunk = samples + start_sample;
+  int32_t chunk_size = end_sample - start_sample;
+  int32_t first = (start_sample + hop_length / 2) / hop_length;
+  int32_t count = (chunk_size + n_fft / 2 - 1) / hop_length + 1;
+  count = std::max(0, std::min(count, num_frames));
+  edges.assign(static_cast<size_t>(count) * mels, 0.0f);
+  int32_t stored = std::max(0, std::min(count, frames - first));
+  if (stored > 0) {
+    std::copy(data.begin() + static_cast<size_t>(first) * mels,
+              data.begin() + static_cast<size_t>(first + stored) * mels,
+              edges.begin());
+  }
+
+  // Frames reaching past the chunk see audio around it in the file, they're
+  // recomputed over the chunk alone so no other speaker leaks in
+  FrameState state;
+  for (int32_t i = 0; i < count; i++) {
+    int32_t begin = i * hop_length - n_fft / 2;
+    if (begin < 0 || begin + n_fft > chunk_size || i >= stored) {
+      compute_frame(chunk, chunk_size, i, filters, ranges, state,
+                    edges.data() + static_cast<size_t>(i) * mels);
+    }
+  }
+
+  // Whisper clamps to 8 below the chunk's maximum and scales
+  float max = silence;
+  for (auto value : edges) {
+    max = std::max(max, value);
+  }
+  float floor = max - 8.0f;
+  auto normalize = [floor](float value) {
+    return (std::max(value, floor) + 4.0f) / 4.0f;
+  };
+
+  out.assign(static_cast<size_t>(num_frames) * mels, normalize(silence));
+  for (int32_t i = 0; i < count; i++) {
+    const float *frame = edges.data() + static_cast<size_t>(i) * mels;
+    for (int32_t m = 0; m < mels; m++) {
+      out[static_cast<size_t>(m) * num_frames + i] = normalize(frame[m]);
+    }
+  }
+}
+
+} // namespace mel
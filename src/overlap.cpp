@@ -0,0 +1,104 @@
+#include "overlap.h"
+#include <algorithm>
+
+namespace overlap {
+
+static bool same_speakers(const Span &a, const Span &b) {
+  auto x = a.speakers;
+  auto y = b.speakers;
+  std::sort(x.begin(), x.end());
+  std::sort(y.begin(), y.end());
+  return x == y;
+}
+
+static bool shares_speaker(const Span &a, const Span &b) {
+  for (auto speaker : a.speakers) {
+    if (std::find(b.speakers.begin(), b.speakers.end(), speaker) !=
+        b.speakers.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<Span>
+resolve(const std::vector<diarization::DiarizationSegment> &segments,
+        float min_seconds) {
+  std::vector<diarization::DiarizationSegment> sorted;
+  std::vector<float> bounds;
+  for (const auto &segment : segments) {
+    if (segment.end > segment.start) {
+      sorted.push_back(segment);
+      bounds.push_back(segment.start);
+      bounds.push_back(segment.end);
+    }
+  }
+  std::stable_sort(
+      sorted.begin(), sorted.end(),
+      [](const auto &a, const auto &b) { return a.start < b.start; });
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+  // Sweep the elementary intervals between bounds, with the segments active
+  // over each in start order
+  std::vector<Span> spans;
+  std::vector<diarization::DiarizationSegment> active;
+  size_t next = 0;
+  for (size_t b = 0; b + 1 < bounds.size(); b++) {
+    float start = bounds[b];
+    float end = bounds[b + 1];
+    while (next < sorted.size() && sorted[next].start <= start) {
+      active.push_back(sorted[next++]);
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [start](const auto &segment) {
+                                  return segment.end <= start;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      continue;
+    }
+
+    Span span{start, end, {}};
+    for (const auto &segment : active) {
+      if (std::find(span.speakers.begin(), span.speakers.end(),
+                    segment.speaker) == span.speakers.end()) {
+        span.speakers.push_back(segment.speaker);
+      }
+    }
+    if (!spans.empty() && spans.back().end == start &&
+        same_speakers(spans.back(), span)) {
+      spans.back().end = end;
+    } else {
+      spans.push_back(std::move(span));
+    }
+  }
+
+  // Short spans go to a touching neighbour with one of their speakers,
+  // which keeps its own speakers
+  std::vector<Span> resolved;
+  for (size_t i = 0; i < spans.size(); i++) {
+    auto &span = spans[i];
+    if (span.end - span.start < min_seconds) {
+      if (!resolved.empty() && resolved.back().end == span.start &&
+          shares_speaker(resolved.back(), span)) {
+        resolved.back().end = span.end;
+        continue;
+      }
+      if (i + 1 < spans.size() && spans[i + 1].start == span.end &&
+          shares_speaker(spans[i + 1], span)) {
+        spans[i + 1].start = span.start;
+        continue;
+      }
+    }
+    if (!resolved.empty() && resolved.back().end == span.start &&
+        same_speakers(resolved.back(), span)) {
+      resolved.back().end = span.end;
+      continue;
+    }
+    resolved.push_back(std::move(span));
+  }
+  return resolved;
+}
+
+} // namespace overlap
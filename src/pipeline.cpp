@@ -0,0 +1,674 @@
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+
+#include "pipeline.h"
+#include "backend.h"
+#include "diarization.h"
+#include "diarizer.h"
+#include "embedding.h"
+#include "progress.h"
+#include "rttm.h"
+#include "transcribe.h"
+#include "vad.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <spdlog/spdlog.h>
+#include <termcolor/termcolor.hpp>
+
+namespace fs = std::filesystem;
+
+namespace pipeline {
+
+Engine::Engine(Options options) : opts(std::move(options)) {}
+
+Engine::~Engine() {
+  if (extractor) {
+    SherpaOnnxDestroySpeakerEmbeddingExtractor(extractor);
+  }
+}
+
+bool Engine::load_speaker_index() {
+  if (index_loaded) {
+    return true;
+  }
+  if (!opts.speaker_db_path.empty() && fs::exists(opts.speaker_db_path) &&
+      !index.load(opts.speaker_db_path)) {
+    SPDLOG_ERROR("Failed to load speaker index {}", opts.speaker_db_path);
+    return false;
+  }
+  index_loaded = true;
+  return true;
+}
+
+// Name of a model file or directory, without where it's installed
+static std::string model_name(const std::string &path) {
+  auto model = fs::path(path).lexically_normal();
+  if (!model.has_filename()) {
+    model = model.parent_path();
+  }
+  return model.filename().string();
+}
+
+bool Engine::load_dedup_index() {
+  if (dedup_loaded || opts.dedup_index_path.empty()) {
+    return true;
+  }
+  // The transcripts it reuses must come from the same models and language
+  if (opts.asr_backend == "sherpa") {
+    dedup.model = "sherpa:" + model_name(opts.sherpa_asr_model_path);
+  } else if (opts.asr_backend == "whisper") {
+    dedup.model = "whisper:" + model_name(opts.whisper_model_path);
+  } else {
+    dedup.model = opts.asr_backend;
+  }
+  if (!opts.refine_model_path.empty()) {
+    dedup.model += "+" + model_name(opts.refine_model_path);
+  }
+  dedup.language = opts.language;
+  if (fs::exists(opts.dedup_index_path) &&
+      !dedup.load(opts.dedup_index_path)) {
+    SPDLOG_ERROR("Failed to load fingerprint index {}",
+                 opts.dedup_index_path);
+    return false;
+  }
+  SPDLOG_DEBUG("Loaded {} fingerprints from {}", dedup.size(),
+               opts.dedup_index_path);
+  dedup_loaded = true;
+  return true;
+}
+
+void Engine::save_dedup_index() {
+  if (opts.dedup_index_path.empty()) {
+    return;
+  }
+  if (!dedup.save(opts.dedup_index_path)) {
+    SPDLOG_WARN("Failed to save fingerprint index {}", opts.dedup_index_path);
+  }
+}
+
+std::unique_ptr<transcriber::Transcriber>
+Engine::create_transcriber(const std::string &model_path) {
+  if (opts.asr_backend == "mock") {
+    transcriber::MockConfig mock;
+    mock.rtf = opts.mock_asr_rtf;
+    return std::make_unique<transcriber::MockTranscriber>(mock);
+  }
+  if (opts.asr_backend == "sherpa") {
+    transcriber::SherpaConfig config;
+    config.model_dir = model_path;
+    config.model_type = opts.sherpa_asr_model_type;
+    config.language = opts.language;
+    config.provider = opts.onnx_provider;
+    config.num_threads = opts.onnx_num_threads;
+    config.batch_size = opts.asr_batch_size;
+    return transcriber::SherpaTranscriber::create(config);
+  }
+  if (opts.asr_backend != "whisper") {
+    SPDLOG_ERROR("Unknown asr backend {}", opts.asr_backend);
+    return nullptr;
+  }
+
+  // The CPU variant is picked before the first model loads
+  if (!backend::load_cpu_variant(opts.cpu_variant)) {
+    return nullptr;
+  }
+  auto start_time = std::chrono::steady_clock::now();
+  auto whisper = transcriber::WhisperTranscriber::create(
+      model_path, opts.language, opts.shared_mel);
+  if (!whisper) {
+    return nullptr;
+  }
+  SPDLOG_DEBUG("Loaded whisper model in {:.2f}s",
+               std::chrono::duration<float>(
+                   std::chrono::steady_clock::now() - start_time)
+                   .count());
+  if (!asr) {
+    backend::log_cpu_backend();
+  }
+  return whisper;
+}
+
+std::unique_ptr<diarizer::Diarizer> Engine::create_diarizer() {
+  if (opts.diarization_backend == "mock") {
+    transcriber::MockConfig mock;
+    mock.rtf = opts.mock_diarization_rtf;
+    return std::make_unique<diarizer::MockDiarizer>(mock, opts.num_speakers);
+  }
+  if (opts.diarization_backend != "sherpa") {
+    SPDLOG_ERROR("Unknown diarization backend {}", opts.diarization_backend);
+    return nullptr;
+  }
+  diarization::WindowedConfig config;
+  config.segmentation_model_path = opts.segmentation_model_path;
+  config.embedding_model_path = opts.embedding_model_path;
+  config.provider = opts.onnx_provider;
+  config.num_clusters = opts.num_speakers;
+  config.window_seconds = opts.diarization_window;
+  config.overlap_seconds = opts.diarization_window_overlap;
+  config.num_workers = opts.diarization_workers;
+  config.onnx_num_threads = opts.onnx_num_threads;
+  return diarizer::SherpaDiarizer::create(config);
+}
+
+bool Engine::load() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!load_speaker_index() || !load_dedup_index()) {
+    return false;
+  }
+
+  if (!diarizer && !opts.channels_as_speakers &&
+      opts.diarization_input_path.empty()) {
+    diarizer = create_diarizer();
+    if (!diarizer) {
+      SPDLOG_ERROR("Failed to load diarization models");
+      return false;
+    }
+  }
+
+  if (index.size() > 0 && !extractor) {
+    extractor = embedding::create_extractor(
+        opts.embedding_model_path, opts.onnx_provider, opts.onnx_num_threads);
+    if (!extractor) {
+      SPDLOG_ERROR("Failed to load embedding model");
+      return false;
+    }
+  }
+
+  // Diarization only runs never load a whisper model
+  if (opts.diarization_only) {
+    return true;
+  }
+  if (!asr) {
+    asr = create_transcriber(opts.asr_backend == "sherpa"
+                                 ? opts.sherpa_asr_model_path
+                                 : opts.whisper_model_path);
+    if (!asr) {
+      return false;
+    }
+  }
+  if (!opts.deadline_model_path.empty() && !fallback_asr) {
+    fallback_asr = create_transcriber(opts.deadline_model_path);
+    if (!fallback_asr) {
+      return false;
+    }
+  }
+  if (!opts.refine_model_path.empty() && !refine_asr) {
+    refine_asr = create_transcriber(opts.refine_model_path);
+    if (!refine_asr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Steps in the order they're taken, the cheap ones on accuracy first
+std::unique_ptr<deadline::Controller>
+Engine::create_deadline(float duration,
+                        deadline::Controller::Clock::time_point start) const {
+  double budget = opts.deadline > 0.0f ? opts.deadline
+                                       : opts.target_rtf * duration;
+  if (budget <= 0.0) {
+    return nullptr;
+  }
+  std::vector<deadline::Step> steps = {deadline::Step::no_fallback};
+  if (!opts.dynamic_audio_ctx) {
+    steps.push_back(deadline::Step::reduced_audio_ctx);
+  }
+  if (fallback_asr) {
+    steps.push_back(deadline::Step::fallback_model);
+  }
+  SPDLOG_INFO("Deadline of {:.1f}s for {:.1f}s of audio", budget, duration);
+  return std::make_unique<deadline::Controller>(budget, start,
+                                                std::move(steps));
+}
+
+std::unique_ptr<guard::Guard> Engine::create_guard() const {
+  if (!opts.decode_guard && opts.fallback_budget < 0 &&
+      opts.decode_timeout <= 0.0f) {
+    return nullptr;
+  }
+  guard::Config config;
+  if (!opts.decode_guard) {
+    config.max_tokens_per_second = 0.0f;
+    config.max_ngram = 0;
+  }
+  config.fallback_budget = opts.fallback_budget;
+  config.chunk_timeout = opts.decode_timeout;
+  return std::make_unique<guard::Guard>(config);
+}
+
+std::unique_ptr<gate::Gate> Engine::create_gate() const {
+  if (opts.speech_gate <= 0.0f) {
+    return nullptr;
+  }
+  gate::Config config;
+  config.threshold = opts.speech_gate;
+  return std::make_unique<gate::Gate>(config);
+}
+
+segments::Options
+Engine::create_segment_options(const segments::SegmentCallback &on_segment,
+                               deadline::Controller *controller,
+                               guard::Guard *guard, gate::Gate *gate) {
+  segments::Options segment_options;
+  segment_options.dynamic_audio_ctx = opts.dynamic_audio_ctx;
+  segment_options.on_segment = on_segment;
+  if (!opts.dedup_index_path.empty()) {
+    segment_options.dedup = &dedup;
+  }
+  segment_options.deadline = controller;
+  segment_options.fallback = fallback_asr.get();
+  segment_options.refine = refine_asr.get();
+  segment_options.refine_logprob_threshold = opts.refine_logprob_threshold;
+  segment_options.refine_compression_ratio = opts.refine_compression_ratio;
+  segment_options.guard = guard;
+  segment_options.resolve_overlaps = opts.resolve_overlaps;
+  segment_options.gate = gate;
+  return segment_options;
+}
+
+bool Engine::run_diarizer(
+    const SherpaOnnxWave *wave, const std::string &cache_key,
+    std::vector<diarization::DiarizationSegment> &segments) {
+  auto &stage = progress::begin("diarization", "Diarization...", 0,
+                                wave->num_samples / 16000.0);
+  bool diarized = diarizer->diarize(wave, cache_key, stage, segments);
+  progress::end(stage);
+  return diarized;
+}
+
+// Turns of the RTTM input within the audio that starts offset seconds into
+// the file, in audio time
+bool Engine::read_turns(const SherpaOnnxWave *wave, float offset,
+                        std::vector<diarization::DiarizationSegment> &turns,
+                        std::map<int32_t, std::string> &names) const {
+  std::vector<diarization::DiarizationSegment> file_turns;
+  if (!rttm::load(opts.diarization_input_path, file_turns, names)) {
+    return false;
+  }
+  float duration = wave->num_samples / 16000.0f;
+  turns.clear();
+  for (auto turn : file_turns) {
+    turn.start = std::max(0.0f, turn.start - offset);
+    turn.end = std::min(duration, turn.end - offset);
+    if (turn.end > turn.start) {
+      turns.push_back(turn);
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<vad::CompactAudio>
+Engine::compact(const SherpaOnnxWave *wave) const {
+  vad::VadConfig vad_config;
+  vad_config.model_path = opts.vad_model_path;
+  vad_config.provider = opts.onnx_provider;
+  vad_config.onnx_num_threads = opts.onnx_num_threads;
+  vad_config.threshold = opts.vad_threshold;
+  auto compacted = vad::compact_speech(wave, vad_config);
+  if (!compacted) {
+    SPDLOG_ERROR("Voice activity detection failed");
+  }
+  return compacted;
+}
+
+// Name diarized speakers that match enrolled ones
+std::map<int32_t, std::string> Engine::identify_speakers(
+    const SherpaOnnxWave *wave,
+    const std::vector<diarization::DiarizationSegment> &segments) {
+  if (index.size() == 0 || !extractor) {
+    return {};
+  }
+  auto centroids = embedding::speaker_centroids(extractor, wave->samples,
+                                                wave->num_samples, segments);
+  auto names = speakers::identify(index, centroids, opts.speaker_threshold,
+                                  opts.speaker_db_int8);
+  for (const auto &[speaker, name] : names) {
+    SPDLOG_INFO("Speaker {} identified as {}", speaker, name);
+  }
+  return names;
+}
+
+// Map timestamps of audio that starts offset seconds into the original file
+static segments::TimeMap with_offset(segments::TimeMap time_map,
+                                     float offset) {
+  if (offset == 0.0f) {
+    return time_map;
+  }
+  return [time_map = std::move(time_map), offset](float seconds, bool is_end) {
+    return (time_map ? time_map(seconds, is_end) : seconds) + offset;
+  };
+}
+
+// Turns of the processed audio in file time
+static std::vector<diarization::DiarizationSegment>
+to_file_time(std::vector<diarization::DiarizationSegment> turns,
+             const segments::TimeMap &time_map) {
+  if (time_map) {
+    for (auto &turn : turns) {
+      turn.start = time_map(turn.start, false);
+      turn.end = time_map(turn.end, true);
+    }
+  }
+  return turns;
+}
+
+bool Engine::process(const SherpaOnnxWave *wave, nlohmann::ordered_json &result,
+                     const segments::SegmentCallback &on_segment,
+                     const std::string &cache_key, float offset,
+                     std::vector<diarization::DiarizationSegment> *turns,
+                     deadline::Controller::Clock::time_point started) {
+  if (started == deadline::Controller::Clock::time_point{}) {
+    started = deadline::Controller::Clock::now();
+  }
+  if (!load()) {
+    return false;
+  }
+  if (!asr) {
+    SPDLOG_ERROR("Transcription is disabled in diarization only runs");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto start_time = std::chrono::steady_clock::now();
+  result = nlohmann::ordered_json::array();
+
+  // Compact speech regions so silence never reaches the models. Given turns
+  // already say where the speech is
+  bool given_turns = !opts.diarization_input_path.empty();
+  const SherpaOnnxWave *input = wave;
+  std::unique_ptr<vad::CompactAudio> compacted;
+  segments::TimeMap time_map;
+  if (opts.use_vad && !given_turns) {
+    compacted = compact(wave);
+    if (!compacted) {
+      return false;
+    }
+    input = &compacted->wave;
+    time_map = [&compacted](float seconds, bool is_end) {
+      return compacted->to_original(seconds, is_end);
+    };
+    if (input->num_samples == 0) {
+      if (opts.print_status) {
+        std::cout << termcolor::red << "x" << termcolor::reset
+                  << " No speech found!" << std::endl;
+      }
+      return true;
+    }
+  }
+
+  std::vector<diarization::DiarizationSegment> diarized;
+  std::map<int32_t, std::string> labels;
+  if (given_turns) {
+    if (!read_turns(wave, offset, diarized, labels)) {
+      return false;
+    }
+  } else if (!run_diarizer(input, cache_key, diarized)) {
+    return false;
+  }
+  if (opts.print_status) {
+    std::cout << termcolor::green << "✓" << termcolor::reset
+              << (given_turns ? " Read " + std::to_string(diarized.size()) +
+                                    " speaker turns!"
+                              : " Diarization complete!")
+              << std::endl;
+  }
+
+  auto controller = create_deadline(wave->num_samples / 16000.0f, started);
+  auto decode_guard = create_guard();
+  // The refine model's retries don't spend the first pass's budget
+  auto refine_guard = refine_asr ? create_guard() : nullptr;
+  auto speech_gate = create_gate();
+  auto segment_options = create_segment_options(
+      on_segment, controller.get(), decode_guard.get(), speech_gate.get());
+  segment_options.refine_guard = refine_guard.get();
+  segment_options.speaker_names = identify_speakers(input, diarized);
+  // RTTM labels name the speakers the index doesn't
+  segment_options.speaker_names.insert(labels.begin(), labels.end());
+
+  if (opts.print_status) {
+    std::cout << "Starting parse segments!" << std::endl;
+  }
+  auto file_time = with_offset(time_map, offset);
+  if (turns) {
+    *turns = to_file_time(diarized, file_time);
+  }
+  result = segments::process_segments(diarized, input, *asr, file_time,
+                                      segment_options);
+  save_dedup_index();
+
+  auto elapsed = std::chrono::duration<float>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  float duration = wave->num_samples / 16000.0f;
+  SPDLOG_INFO("Processed {:.1f}s of audio in {:.1f}s (RTF {:.3f})", duration,
+              elapsed, elapsed / duration);
+  if (compacted) {
+    SPDLOG_INFO("VAD skipped {:.1f}% of the audio",
+                compacted->skipped_fraction() * 100.0f);
+  }
+  return true;
+}
+
+bool Engine::process_channels(const channels::MultiChannelAudio &audio,
+                              nlohmann::ordered_json &result,
+                              const segments::SegmentCallback &on_segment,
+                              deadline::Controller::Clock::time_point started) {
+  if (started == deadline::Controller::Clock::time_point{}) {
+    started = deadline::Controller::Clock::now();
+  }
+  if (!load()) {
+    return false;
+  }
+  if (!asr) {
+    SPDLOG_ERROR("Transcription is disabled in diarization only runs");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto start_time = std::chrono::steady_clock::now();
+  result = nlohmann::ordered_json::array();
+  int32_t num_samples = audio.num_samples();
+  if (num_samples == 0) {
+    return true;
+  }
+
+  std::vector<diarization::DiarizationSegment> turns;
+  if (opts.use_vad) {
+    for (size_t c = 0; c < audio.channels.size(); c++) {
+      SherpaOnnxWave channel;
+      channel.samples = audio.channels[c].data();
+      channel.sample_rate = 16000;
+      channel.num_samples = num_samples;
+      auto compacted = compact(&channel);
+      if (!compacted) {
+        return false;
+      }
+      for (const auto &region : compacted->regions) {
+        turns.push_back(
+            {static_cast<float>(region.original_start) / 16000,
+             static_cast<float>(region.original_start + region.length) / 16000,
+             static_cast<int32_t>(c)});
+      }
+    }
+    std::sort(turns.begin(), turns.end(),
+              [](const auto &a, const auto &b) { return a.start < b.start; });
+  } else {
+    turns = channels::speech_turns(audio);
+  }
+  if (opts.print_status) {
+    std::cout << termcolor::green << "✓" << termcolor::reset << " Found "
+              << turns.size() << " speech turns in " << audio.channels.size()
+              << " channels" << std::endl;
+  }
+
+  // Transcribe from one buffer with the channels back to back, turns are
+  // shifted into their channel and mapped back by the time map
+  std::vector<float> joined;
+  joined.reserve(static_cast<size_t>(num_samples) * audio.channels.size());
+  for (const auto &channel : audio.channels) {
+    joined.insert(joined.end(), channel.begin(), channel.end());
+  }
+  float duration = num_samples / 16000.0f;
+  for (auto &turn : turns) {
+    turn.start += turn.speaker * duration;
+    turn.end += turn.speaker * duration;
+  }
+  segments::TimeMap time_map = [duration](float seconds, bool is_end) {
+    auto channel = static_cast<int32_t>(seconds / duration);
+    // Ends on a channel boundary belong to the earlier channel
+    if (is_end && channel > 0 && seconds <= channel * duration) {
+      channel--;
+    }
+    return seconds - channel * duration;
+  };
+  SherpaOnnxWave wave;
+  wave.samples = joined.data();
+  wave.sample_rate = 16000;
+  wave.num_samples = static_cast<int32_t>(joined.size());
+
+  auto controller = create_deadline(duration, started);
+  auto decode_guard = create_guard();
+  // The refine model's retries don't spend the first pass's budget
+  auto refine_guard = refine_asr ? create_guard() : nullptr;
+  auto speech_gate = create_gate();
+  auto segment_options = create_segment_options(
+      on_segment, controller.get(), decode_guard.get(), speech_gate.get());
+  segment_options.refine_guard = refine_guard.get();
+  segment_options.speaker_names = identify_speakers(&wave, turns);
+
+  result = segments::process_segments(turns, &wave, *asr,
+                                      with_offset(time_map, audio.offset),
+                                      segment_options);
+  save_dedup_index();
+
+  auto elapsed = std::chrono::duration<float>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  SPDLOG_INFO("Processed {} channels of {:.1f}s in {:.1f}s (RTF {:.3f})",
+              audio.channels.size(), duration, elapsed, elapsed / duration);
+  return true;
+}
+
+bool Engine::diarize(const SherpaOnnxWave *wave,
+                     std::vector<diarization::DiarizationSegment> &turns,
+                     std::map<int32_t, std::string> &names,
+                     const std::string &cache_key, float offset) {
+  if (!load()) {
+    return false;
+  }
+  if (!diarizer) {
+    SPDLOG_ERROR("Diarization models aren't loaded with given speaker turns "
+                 "or channels as speakers");
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto start_time = std::chrono::steady_clock::now();
+  turns.clear();
+  names.clear();
+
+  const SherpaOnnxWave *input = wave;
+  std::unique_ptr<vad::CompactAudio> compacted;
+  segments::TimeMap time_map;
+  if (opts.use_vad) {
+    compacted = compact(wave);
+    if (!compacted) {
+      return false;
+    }
+    input = &compacted->wave;
+    time_map = [&compacted](float seconds, bool is_end) {
+      return compacted->to_original(seconds, is_end);
+    };
+    if (input->num_samples == 0) {
+      return true;
+    }
+  }
+
+  std::vector<diarization::DiarizationSegment> diarized;
+  if (!run_diarizer(input, cache_key, diarized)) {
+    return false;
+  }
+  names = identify_speakers(input, diarized);
+  turns = to_file_time(diarized, with_offset(time_map, offset));
+
+  auto elapsed = std::chrono::duration<float>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  float duration = wave->num_samples / 16000.0f;
+  SPDLOG_INFO("Diarized {:.1f}s of audio into {} turns in {:.1f}s (RTF "
+              "{:.3f})",
+              duration, turns.size(), elapsed, elapsed / duration);
+  return true;
+}
+
+std::map<int32_t, std::vector<float>> Engine::speaker_centroids(
+    const SherpaOnnxWave *wave,
+    const std::vector<diarization::DiarizationSegment> &turns, float offset) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto local = turns;
+  for (auto &turn : local) {
+    turn.start -= offset;
+    turn.end -= offset;
+  }
+  if (opts.diarization_backend == "mock") {
+    return embedding::speaker_centroids(embedding::mock_embedding,
+                                        wave->samples, wave->num_samples,
+                                        local);
+  }
+  if (!extractor) {
+    extractor = embedding::create_extractor(
+        opts.embedding_model_path, opts.onnx_provider, opts.onnx_num_threads);
+    if (!extractor) {
+      SPDLOG_ERROR("Failed to load embedding model");
+      return {};
+    }
+  }
+  return embedding::speaker_centroids(extractor, wave->samples,
+                                      wave->num_samples, local);
+}
+
+bool Engine::enroll(const SherpaOnnxWave *wave, const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (opts.speaker_db_path.empty()) {
+    SPDLOG_ERROR("Enrolling requires a speaker index path");
+    return false;
+  }
+  if (!load_speaker_index()) {
+    return false;
+  }
+  if (!extractor) {
+    extractor = embedding::create_extractor(
+        opts.embedding_model_path, opts.onnx_provider, opts.onnx_num_threads);
+    if (!extractor) {
+      SPDLOG_ERROR("Failed to load embedding model");
+      return false;
+    }
+  }
+
+  // Enroll only the speech, like it's seen when processing
+  std::unique_ptr<vad::CompactAudio> compacted;
+  if (opts.use_vad) {
+    compacted = compact(wave);
+    if (!compacted) {
+      return false;
+    }
+    wave = &compacted->wave;
+  }
+
+  auto embedding =
+      embedding::compute_embedding(extractor, wave->samples, wave->num_samples);
+  if (embedding.empty()) {
+    SPDLOG_ERROR("Audio is too short to enroll {}", name);
+    return false;
+  }
+  if (!index.enroll(name, embedding)) {
+    SPDLOG_ERROR("Failed to enroll {} into {}", name, opts.speaker_db_path);
+    return false;
+  }
+  if (!index.save(opts.speaker_db_path)) {
+    SPDLOG_ERROR("Failed to save speaker index {}", opts.speaker_db_path);
+    return false;
+  }
+  return true;
+}
+
+} // namespace pipeline
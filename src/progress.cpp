@@ -0,0 +1,305 @@
+#include "progress.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <termcolor/termcolor.hpp>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/signal.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#endif
+
+namespace progress {
+
+struct Reporter {
+  Mode mode = Mode::Off;
+  int fd = -1;
+  std::mutex output_mutex;   // Guards stdout and the rendered line
+  std::mutex stages_mutex;   // Guards stages, not held on the hot path
+  std::deque<std::unique_ptr<Stage>> stages;
+  std::atomic<Stage *> current{nullptr};
+  std::atomic<bool> running{false};
+  std::thread thread;
+  size_t line_length = 0;
+
+  ~Reporter() { shutdown(); }
+};
+
+static Reporter reporter;
+
+static void hideCursor() {
+#ifdef _WIN32
+  // Windows-specific code to hide cursor
+  HANDLE consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+  CONSOLE_CURSOR_INFO cursorInfo;
+  GetConsoleCursorInfo(consoleHandle, &cursorInfo);
+  cursorInfo.bVisible = FALSE; // Set visibility to FALSE
+  SetConsoleCursorInfo(consoleHandle, &cursorInfo);
+#else
+  std::cout << "\033[?25l"; // ANSI escape code to hide cursor
+#endif
+}
+
+static void showCursor() {
+#ifdef _WIN32
+  // Windows-specific code to show cursor
+  HANDLE consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+  CONSOLE_CURSOR_INFO cursorInfo;
+  GetConsoleCursorInfo(consoleHandle, &cursorInfo);
+  cursorInfo.bVisible = TRUE; // Set visibility to TRUE
+  SetConsoleCursorInfo(consoleHandle, &cursorInfo);
+#else
+  std::cout << "\033[?25h" << std::flush; // ANSI escape code to show cursor
+#endif
+}
+
+#ifndef _WIN32
+// Only async signal safe calls: no iostreams, no exit handlers
+static void signalHandler(int signum) {
+  static const char show_cursor[] = "\033[?25h";
+  auto written = write(STDOUT_FILENO, show_cursor, sizeof(show_cursor) - 1);
+  (void)written;
+  _exit(128 + signum);
+}
+#endif
+
+static bool is_tty() {
+#ifdef _WIN32
+  return _isatty(_fileno(stdout));
+#else
+  return isatty(STDOUT_FILENO);
+#endif
+}
+
+static void write_fd(int fd, const std::string &line) {
+#ifdef _WIN32
+  _write(fd, line.data(), static_cast<unsigned int>(line.size()));
+#else
+  size_t written = 0;
+  while (written < line.size()) {
+    auto n = write(fd, line.data() + written, line.size() - written);
+    if (n <= 0) {
+      break;
+    }
+    written += static_cast<size_t>(n);
+  }
+#endif
+}
+
+struct Snapshot {
+  int64_t done;
+  int64_t total;
+  double elapsed;
+  double rtf; // < 0 when unknown
+  double eta; // < 0 when unknown
+};
+
+static Snapshot snapshot(const Stage &stage) {
+  Snapshot s;
+  s.done = stage.done.load(std::memory_order_relaxed);
+  s.total = stage.total.load(std::memory_order_relaxed);
+  s.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            stage.start_time)
+                  .count();
+  s.rtf = -1.0;
+  s.eta = -1.0;
+  if (s.done > 0 && s.total > 0) {
+    double fraction = std::min(1.0, static_cast<double>(s.done) / s.total);
+    if (stage.audio_seconds > 0.0) {
+      s.rtf = s.elapsed / (stage.audio_seconds * fraction);
+    }
+    s.eta = s.elapsed * (1.0 - fraction) / fraction;
+  }
+  return s;
+}
+
+static void clear_line() {
+  if (reporter.line_length > 0) {
+    std::cout << "\r" << std::string(reporter.line_length + 3, ' ') << "\r"
+              << std::flush;
+  }
+}
+
+static void render_tty(const Stage &stage, size_t frame) {
+  static const std::vector<std::string> frames = {"⣾", "⣽", "⣻", "⢿",
+                                                  "⡿", "⣟", "⣯", "⣷"};
+  auto s = snapshot(stage);
+  std::ostringstream message;
+  message << stage.label;
+  if (s.total > 0) {
+    message << " " << std::min<int64_t>(100, s.done * 100 / s.total) << "%";
+  }
+  if (s.eta >= 0.0) {
+    message << " (ETA " << static_cast<int64_t>(s.eta) << "s)";
+  }
+  auto line = message.str();
+
+  // Double parentheses because windows conflict with max() function
+  reporter.line_length = (std::max)(reporter.line_length, line.size());
+  std::cout << "\r" << std::string(reporter.line_length + 3, ' ') << "\r"
+            << termcolor::green << frames[frame % frames.size()]
+            << termcolor::reset << " " << line << std::flush;
+}
+
+static void emit_json(const Stage &stage, bool finished) {
+  auto s = snapshot(stage);
+  nlohmann::ordered_json event = {{"stage", stage.name},
+                                  {"done", s.done},
+                                  {"total", s.total},
+                                  {"elapsed", s.elapsed},
+                                  {"finished", finished}};
+  if (s.rtf >= 0.0) {
+    event["rtf"] = s.rtf;
+  }
+  if (s.eta >= 0.0 && !finished) {
+    event["eta"] = s.eta;
+  }
+  write_fd(reporter.fd, event.dump() + "\n");
+}
+
+static void run() {
+  size_t frame = 0;
+  int64_t last_done = -1;
+  const Stage *last_stage = nullptr;
+  while (reporter.running.load()) {
+    Stage *stage = reporter.current.load();
+    if (stage) {
+      std::lock_guard<std::mutex> lock(reporter.output_mutex);
+      // end() may have raced us, only render what's still current
+      if (stage == reporter.current.load()) {
+        if (reporter.mode == Mode::Tty) {
+          render_tty(*stage, frame++);
+        } else if (reporter.mode == Mode::Json) {
+          int64_t done = stage->done.load(std::memory_order_relaxed);
+          if (stage != last_stage || done != last_done) {
+            emit_json(*stage, false);
+            last_done = done;
+            last_stage = stage;
+          }
+        }
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        reporter.mode == Mode::Json ? 500 : 100)); // Adjust speed here
+  }
+}
+
+Mode detect_mode(int json_fd) {
+  if (json_fd >= 0) {
+    return Mode::Json;
+  }
+  return is_tty() ? Mode::Tty : Mode::Off;
+}
+
+void init(Mode mode, int json_fd) {
+  if (reporter.running.load()) {
+    return;
+  }
+  reporter.mode = mode;
+  reporter.fd = json_fd;
+  if (mode == Mode::Off) {
+    return;
+  }
+
+  if (mode == Mode::Tty) {
+#ifdef _WIN32
+    SetConsoleOutputCP(65001);
+#else
+    // Make sure it shows the cursor when the program exit
+    signal(SIGINT, signalHandler);
+    signal(SIGABRT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    signal(SIGQUIT, signalHandler);
+#endif
+    hideCursor();
+  }
+  reporter.running.store(true);
+  reporter.thread = std::thread(run);
+}
+
+void shutdown() {
+  reporter.running.store(false);
+  if (reporter.thread.joinable()) {
+    // exit() from a signal handler may run on the reporter thread itself
+    if (reporter.thread.get_id() == std::this_thread::get_id()) {
+      reporter.thread.detach();
+    } else {
+      reporter.thread.join();
+    }
+  }
+  if (reporter.mode == Mode::Tty) {
+    // Don't wait for the lock, a signal may arrive while it's held
+    std::unique_lock<std::mutex> lock(reporter.output_mutex,
+                                      std::try_to_lock);
+    clear_line();
+    showCursor();
+#ifndef _WIN32
+    signal(SIGINT, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+#endif
+  }
+  reporter.mode = Mode::Off;
+}
+
+Stage &begin(const std::string &name, const std::string &label, int64_t total,
+             double audio_seconds) {
+  auto stage = std::make_unique<Stage>();
+  stage->name = name;
+  stage->label = label;
+  stage->audio_seconds = audio_seconds;
+  stage->total.store(total);
+  stage->start_time = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(reporter.stages_mutex);
+  reporter.stages.push_back(std::move(stage));
+  reporter.current.store(reporter.stages.back().get());
+  return *reporter.stages.back();
+}
+
+void end(Stage &stage) {
+  {
+    std::lock_guard<std::mutex> lock(reporter.output_mutex);
+    Stage *expected = &stage;
+    reporter.current.compare_exchange_strong(expected, nullptr);
+    if (reporter.mode == Mode::Tty) {
+      clear_line();
+      reporter.line_length = 0;
+    } else if (reporter.mode == Mode::Json) {
+      emit_json(stage, true);
+    }
+  }
+
+  // The reporter only reads the current stage under output_mutex, so the
+  // ended stage can go away. Long running engines would grow otherwise
+  std::lock_guard<std::mutex> lock(reporter.stages_mutex);
+  auto it = std::find_if(reporter.stages.begin(), reporter.stages.end(),
+                         [&stage](const auto &s) { return s.get() == &stage; });
+  if (it != reporter.stages.end()) {
+    reporter.stages.erase(it);
+  }
+}
+
+std::unique_lock<std::mutex> pause() {
+  std::unique_lock<std::mutex> lock(reporter.output_mutex);
+  if (reporter.mode == Mode::Tty) {
+    clear_line();
+  }
+  return lock;
+}
+
+} // namespace progress
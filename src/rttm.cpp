@@ -0,0 +1,145 @@
+#include "rttm.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cctype>
+#include <fmt/core.h>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace rttm {
+
+// Number of a label made of an optional speaker or spk prefix, an optional
+// separator and digits, -1 for any other label
+static int32_t label_number(const std::string &label) {
+  std::string lower = label;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  size_t pos = 0;
+  for (const char *prefix : {"speaker", "spk"}) {
+    if (lower.rfind(prefix, 0) == 0) {
+      pos = std::string(prefix).size();
+      break;
+    }
+  }
+  if (pos > 0 && pos < lower.size() &&
+      (lower[pos] == '_' || lower[pos] == '-')) {
+    pos++;
+  }
+  if (pos == lower.size() || lower.size() - pos > 9) {
+    return -1;
+  }
+  for (size_t i = pos; i < lower.size(); i++) {
+    if (!std::isdigit(static_cast<unsigned char>(lower[i]))) {
+      return -1;
+    }
+  }
+  return std::stoi(lower.substr(pos));
+}
+
+bool load(const std::string &path,
+          std::vector<diarization::DiarizationSegment> &turns,
+          std::map<int32_t, std::string> &names) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("Failed to open RTTM file {}", path);
+    return false;
+  }
+
+  std::vector<std::string> labels;
+  std::vector<float> starts, ends;
+  std::string first_file_id;
+  std::string line;
+  int32_t line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    std::istringstream fields(line);
+    std::string type, file_id, channel, label;
+    float start = 0.0f, duration = 0.0f;
+    if (!(fields >> type) || type != "SPEAKER") {
+      continue; // Comments, blank lines and other RTTM types
+    }
+    std::string ortho, stype;
+    if (!(fields >> file_id >> channel >> start >> duration >> ortho >>
+          stype >> label) ||
+        duration < 0.0f) {
+      SPDLOG_ERROR("Malformed RTTM line {} of {}", line_number, path);
+      return false;
+    }
+    // Turns of several recordings can't be told apart by time
+    if (first_file_id.empty()) {
+      first_file_id = file_id;
+    } else if (file_id != first_file_id) {
+      SPDLOG_ERROR("RTTM file {} holds turns of more than one file ({} and "
+                   "{}), split it per file",
+                   path, first_file_id, file_id);
+      return false;
+    }
+    labels.push_back(label);
+    starts.push_back(start);
+    ends.push_back(start + duration);
+  }
+
+  // Numbered labels keep their numbers, named ones get the lowest numbers
+  // no label holds, in order of first appearance
+  std::set<int32_t> used;
+  for (const auto &label : labels) {
+    int32_t number = label_number(label);
+    if (number >= 0) {
+      used.insert(number);
+    }
+  }
+  std::map<std::string, int32_t> numbers;
+  int32_t next = 0;
+  turns.clear();
+  names.clear();
+  for (size_t i = 0; i < labels.size(); i++) {
+    int32_t speaker = label_number(labels[i]);
+    if (speaker < 0) {
+      auto found = numbers.find(labels[i]);
+      if (found == numbers.end()) {
+        while (used.count(next)) {
+          next++;
+        }
+        found = numbers.emplace(labels[i], next++).first;
+        names[found->second] = labels[i];
+      }
+      speaker = found->second;
+    }
+    turns.push_back({starts[i], ends[i], speaker});
+  }
+  std::stable_sort(
+      turns.begin(), turns.end(),
+      [](const auto &a, const auto &b) { return a.start < b.start; });
+  SPDLOG_INFO("Read {} speaker turns from {}", turns.size(), path);
+  return true;
+}
+
+bool save(const std::string &path, const std::string &file_id,
+          const std::vector<diarization::DiarizationSegment> &turns,
+          const std::map<int32_t, std::string> &names) {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("Failed to open RTTM file {} for writing", path);
+    return false;
+  }
+  // Fields are separated by spaces, names can't hold any
+  auto field = [](std::string value) {
+    std::replace_if(
+        value.begin(), value.end(),
+        [](unsigned char c) { return std::isspace(c); }, '_');
+    return value.empty() ? std::string("<NA>") : value;
+  };
+  std::string id = field(file_id);
+  for (const auto &turn : turns) {
+    auto name = names.find(turn.speaker);
+    std::string label = name != names.end()
+                            ? field(name->second)
+                            : fmt::format("speaker_{:02}", turn.speaker);
+    file << fmt::format("SPEAKER {} 1 {:.3f} {:.3f} <NA> <NA> {} <NA> <NA>\n",
+                        id, turn.start, turn.end - turn.start, label);
+  }
+  return file.good();
+}
+
+} // namespace rttm
@@ -1,94 +1,441 @@
+#include "segments.h"
 #include "diarization.h"
+#include "fingerprint.h"
+#include "overlap.h"
+#include "progress.h"
 #include "sherpa-onnx/c-api/c-api.h"
 #include "transcribe.h"
+#include "transcriber.h"
+#include "spdlog/spdlog.h"
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
 #include <nlohmann/json.hpp>
 #include <vector>
-#include <whisper.h>
 
 namespace segments {
+
+// Shorter segments aren't transcribed
+static const float min_segment_seconds = 0.5f;
+
+// What came of transcribing a chunk. degraded lists the deadline steps it
+// was transcribed with, refined is set when the draft was replaced and
+// stopped is what the decode guard cut its text short on
+struct ChunkResult {
+  std::string text;
+  std::vector<std::string> degraded;
+  bool refined = false;
+  guard::Outcome stopped;
+};
+
 static void
-handle_segment(whisper_context *ctx, whisper_full_params params,
-               nlohmann::ordered_json *json,
+handle_segment(const ChunkResult &result, nlohmann::ordered_json *json,
                const std::vector<diarization::DiarizationSegment> &segments,
-               std::vector<float> segment_data, int32_t index) {
-  auto text = transcribe::transcribe_audio_chunk(
-      ctx, params, segment_data.data(), segment_data.size());
-
-  if (text.empty()) {
+               int32_t index, const TimeMap &time_map, const Options &options,
+               const std::vector<int32_t> &overlapped) {
+  if (result.text.empty()) {
     return;
   }
 
-  json->push_back({{"text", text},
-                   {"start", segments[index].start},
-                   {"end", segments[index].end},
-                   {"speaker", segments[index].speaker}});
+  auto segment = segments[index];
+  if (time_map) {
+    segment.start = time_map(segment.start, false);
+    segment.end = time_map(segment.end, true);
+  }
+
+  nlohmann::ordered_json item = {{"text", result.text},
+                                 {"start", segment.start},
+                                 {"end", segment.end},
+                                 {"speaker", segment.speaker}};
+  auto name = options.speaker_names.find(segment.speaker);
+  if (name != options.speaker_names.end()) {
+    item["speaker_name"] = name->second;
+  }
+  if (!overlapped.empty()) {
+    item["speakers"] = overlapped;
+    item["overlap"] = true;
+  }
+  if (!result.degraded.empty()) {
+    item["degraded"] = result.degraded;
+  }
+  if (result.refined) {
+    item["refined"] = true;
+  }
+  if (result.stopped.cut()) {
+    item["stopped"] = result.stopped.names();
+  }
+  json->push_back(item);
 
-  diarization::print_segment(segments[index], text);
+  if (options.on_segment) {
+    options.on_segment(item);
+  }
 }
 
-nlohmann::ordered_json process_segments(
-    std::vector<diarization::DiarizationSegment> segments,
-    const SherpaOnnxWave *wave, // Assuming Wave is a defined struct or class
-    whisper_context *ctx,       // Assuming Context is a defined struct or class
-    whisper_full_params params  // Assuming Params is a defined struct or class
-) {
-  nlohmann::ordered_json json = nlohmann::json::array();
+// Time spent in the transcriber, to estimate what reused transcripts and the
+// draft model saved
+struct TranscribeTime {
+  double audio_seconds = 0.0;
+  double elapsed = 0.0;
+  int32_t degraded_chunks = 0;
+  int32_t drafted_chunks = 0;
+  int32_t refined_chunks = 0;
+  double refined_audio_seconds = 0.0;
+  double refine_elapsed = 0.0;
+};
 
-  // Iterate diarize segments
+// Summary of what a guard did over the run
+static void log_guard(const char *name, const guard::Guard &guard) {
+  const auto &stats = guard.stats();
+  SPDLOG_INFO("{}: {}/{} chunks stopped on loops, {} on the token cap, {} "
+              "aborted, {} retried ({} retries), {} without retries over the "
+              "budget",
+              name, stats.loops, stats.chunks, stats.token_caps, stats.aborted,
+              stats.retried, stats.retries, stats.denied);
+}
 
-  for (int32_t i = 0; i != segments.size(); ++i) {
+// Whether a draft transcript is worth another pass with the larger model
+static bool needs_refinement(const std::string &text,
+                             const transcribe::Confidence &confidence,
+                             const Options &options) {
+  if (text.empty()) {
+    return false;
+  }
+  return confidence.avg_logprob < options.refine_logprob_threshold ||
+         confidence.compression_ratio > options.refine_compression_ratio;
+}
+
+// Audio of a diarized segment, at most 30 seconds of it
+struct Chunk {
+  int32_t index; // Of the segment
+  int32_t start_sample;
+  int32_t end_sample;
+};
 
+// Split the segments into chunks of at most 30 seconds, skipping segments
+// shorter than min_segment_seconds and those the gate finds aren't speech
+static std::vector<Chunk>
+plan_chunks(const std::vector<diarization::DiarizationSegment> &segments,
+            const SherpaOnnxWave *wave, gate::Gate *gate) {
+  int32_t num_samples = wave->num_samples;
+  std::vector<Chunk> chunks;
+  for (int32_t i = 0; i != segments.size(); ++i) {
     // Calculate start and end samples for the segment
     int32_t start_sample = static_cast<int32_t>(segments[i].start * 16000);
     int32_t end_sample = static_cast<int32_t>(segments[i].end * 16000);
-
-    // skip segments that are less than 0.5s
-    if ((end_sample - start_sample) < 16000 / 2) {
+    if ((end_sample - start_sample) < min_segment_seconds * 16000) {
       continue;
     }
 
     // Ensure start and end are within bounds
-    if (start_sample < 0) {
-      start_sample = 0;
-    }
-    if (end_sample > wave->num_samples) {
-      end_sample = wave->num_samples;
+    start_sample = std::max(start_sample, 0);
+    end_sample = std::min(end_sample, num_samples);
+    if (gate && end_sample > start_sample &&
+        !gate->is_speech(wave->samples + start_sample,
+                         end_sample - start_sample)) {
+      continue;
     }
 
-    int32_t segment_length = end_sample - start_sample;
     int32_t chunk_size = 16000 * 30; // 30 seconds in samples
+    for (int32_t chunk_start = start_sample; chunk_start < end_sample;
+         chunk_start += chunk_size) {
+      chunks.push_back(
+          {i, chunk_start, std::min(chunk_start + chunk_size, end_sample)});
+    }
+  }
+  return chunks;
+}
 
-    // Process longer segments in chunks (no more than 30 seconds each)
-    if (segment_length > chunk_size) {
-      for (int32_t chunk_start = start_sample; chunk_start < end_sample;
-           chunk_start += chunk_size) {
-        int32_t chunk_end = std::min(chunk_start + chunk_size, end_sample);
-
-        // Prepare buffer for the chunk
-        std::vector<float> chunk_data(wave->samples + chunk_start,
-                                      wave->samples + chunk_end);
-
-        // Fill with zeros up to 30 seconds if the chunk is smaller than 30
-        // seconds
-        if (chunk_data.size() < chunk_size) {
-          chunk_data.resize(chunk_size, 0.0f);
-        }
-        handle_segment(ctx, params, &json, segments, chunk_data, i);
-      }
+// Total duration of the segments long enough to be transcribed
+static double transcribed_seconds(
+    const std::vector<diarization::DiarizationSegment> &segments) {
+  double seconds = 0.0;
+  for (const auto &segment : segments) {
+    if (segment.end - segment.start >= min_segment_seconds) {
+      seconds += segment.end - segment.start;
+    }
+  }
+  return seconds;
+}
+
+// Replace overlapping segments by spans of the same speakers, which are
+// transcribed once. overlapped receives the speakers of each overlapped
+// span, and is empty for the others
+static void
+resolve_overlaps(std::vector<diarization::DiarizationSegment> &segments,
+                 std::vector<std::vector<int32_t>> &overlapped) {
+  double before = transcribed_seconds(segments);
+  auto spans = overlap::resolve(segments, min_segment_seconds);
+  size_t num_segments = segments.size();
+  segments.clear();
+  overlapped.clear();
+  int32_t num_overlapped = 0;
+  double overlapped_seconds = 0.0;
+  for (auto &span : spans) {
+    segments.push_back({span.start, span.end, span.speakers.front()});
+    if (span.speakers.size() > 1) {
+      num_overlapped++;
+      overlapped_seconds += span.end - span.start;
+      overlapped.push_back(std::move(span.speakers));
     } else {
-      // Process the segment if it's <= 30 seconds
-      std::vector<float> segment_data(wave->samples + start_sample,
-                                      wave->samples + end_sample);
-
-      // Fill with zeros up to 30 seconds if the segment is smaller than 30
-      // seconds
-      if (segment_data.size() < chunk_size) {
-        segment_data.resize(chunk_size, 0.0f);
+      overlapped.emplace_back();
+    }
+  }
+  SPDLOG_INFO("Resolved {} segments into {} spans, {} of overlapped speech "
+              "({:.1f}s), {:.1f}s of repeated transcription avoided",
+              num_segments, segments.size(), num_overlapped,
+              overlapped_seconds,
+              std::max(0.0, before - transcribed_seconds(segments)));
+}
+
+// Transcribe n chunks in one batch of the transcriber, or reuse transcripts
+// of the same audio from the fingerprint index. remaining_audio is the audio
+// left after them. With a refine model the chunks are drafted with
+// transcriber first
+static void transcribe_chunks(transcriber::Transcriber *transcriber,
+                              const SherpaOnnxWave *wave, const Chunk *chunks,
+                              size_t n, const Options &options,
+                              TranscribeTime &transcribe_time,
+                              double remaining_audio,
+                              std::vector<ChunkResult> &results) {
+  results.assign(n, {});
+  std::vector<fingerprint::Fingerprint> fps(n);
+  std::vector<bool> dedup(n, false);
+  std::vector<size_t> pending;
+  std::vector<transcriber::Samples> batch;
+  for (size_t i = 0; i < n; i++) {
+    const float *samples = wave->samples + chunks[i].start_sample;
+    int n_samples = chunks[i].end_sample - chunks[i].start_sample;
+    dedup[i] = options.dedup && n_samples >= options.dedup->min_seconds * 16000;
+    if (dedup[i]) {
+      fps[i] = fingerprint::compute(samples, n_samples);
+      if (options.dedup->lookup(fps[i], results[i].text)) {
+        continue;
       }
+    }
+    pending.push_back(i);
+    batch.push_back({samples, n_samples});
+  }
+  if (batch.empty()) {
+    return;
+  }
 
-      handle_segment(ctx, params, &json, segments, segment_data, i);
+  transcriber::ChunkOptions chunk_options;
+  chunk_options.dynamic_audio_ctx = options.dynamic_audio_ctx;
+  chunk_options.guard = options.guard;
+  std::vector<std::string> degraded;
+  if (const auto *controller = options.deadline) {
+    degraded = controller->active_steps();
+    if (controller->applies(deadline::Step::no_fallback)) {
+      chunk_options.temperature_fallback = false;
     }
+    if (controller->applies(deadline::Step::reduced_audio_ctx)) {
+      chunk_options.dynamic_audio_ctx = true;
+    }
+    if (controller->applies(deadline::Step::fallback_model)) {
+      transcriber = options.fallback;
+    }
+    if (!degraded.empty()) {
+      transcribe_time.degraded_chunks += static_cast<int32_t>(batch.size());
+    }
+  }
+
+  auto start_time = std::chrono::steady_clock::now();
+  double audio_seconds = 0.0;
+  for (const auto &chunk : batch) {
+    audio_seconds += chunk.n_samples / 16000.0;
+  }
+  std::vector<transcribe::Confidence> confidences;
+  auto texts =
+      transcriber->transcribe_batch(batch, chunk_options, &confidences);
+
+  for (size_t k = 0; k < pending.size(); k++) {
+    auto &result = results[pending[k]];
+    result.text = texts[k];
+    result.degraded = degraded;
+    result.stopped = confidences[k].stopped;
+    // Runs behind the deadline keep the draft
+    if (!options.refine || !degraded.empty()) {
+      continue;
+    }
+    transcribe_time.drafted_chunks++;
+    if (needs_refinement(result.text, confidences[k], options)) {
+      SPDLOG_DEBUG("Refining chunk with avg logprob {:.2f}, compression "
+                   "ratio {:.2f}",
+                   confidences[k].avg_logprob,
+                   confidences[k].compression_ratio);
+      auto refine_start = std::chrono::steady_clock::now();
+      auto refine_options = chunk_options;
+      refine_options.guard = options.refine_guard;
+      transcribe::Confidence refine_confidence;
+      result.text =
+          options.refine->transcribe(batch[k].samples, batch[k].n_samples,
+                                     refine_options, &refine_confidence);
+      result.stopped = refine_confidence.stopped;
+      transcribe_time.refine_elapsed +=
+          std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        refine_start)
+              .count();
+      transcribe_time.refined_audio_seconds += batch[k].n_samples / 16000.0;
+      transcribe_time.refined_chunks++;
+      result.refined = true;
+    }
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count();
+  transcribe_time.audio_seconds += audio_seconds;
+  transcribe_time.elapsed += elapsed;
+  if (options.deadline) {
+    options.deadline->update(audio_seconds, elapsed, remaining_audio);
+  }
+
+  // Drafts of a run behind its deadline, and text the guard cut short,
+  // would be reused as if complete
+  for (auto i : pending) {
+    if (dedup[i] && !results[i].text.empty() && results[i].degraded.empty() &&
+        !results[i].stopped.cut()) {
+      options.dedup->add(std::move(fps[i]), results[i].text);
+    }
+  }
+}
+
+nlohmann::ordered_json process_segments(
+    std::vector<diarization::DiarizationSegment> segments,
+    const SherpaOnnxWave *wave, transcriber::Transcriber &transcriber,
+    const TimeMap &time_map, const Options &options) {
+  nlohmann::ordered_json json = nlohmann::json::array();
+  auto start_time = std::chrono::steady_clock::now();
+  int32_t num_chunks = 0;
+  TranscribeTime transcribe_time;
+  fingerprint::Stats dedup_before;
+  if (options.dedup) {
+    dedup_before = options.dedup->stats();
+  }
+  std::vector<std::vector<int32_t>> overlapped(segments.size());
+  if (options.resolve_overlaps) {
+    resolve_overlaps(segments, overlapped);
+  }
+  auto &stage = progress::begin("transcription", "Transcribing...",
+                                static_cast<int64_t>(segments.size()),
+                                wave->num_samples / 16000.0);
+
+  // Chunks point into the wave, transcribers may precompute over all of it
+  std::vector<transcriber::Transcriber *> transcribers = {&transcriber};
+  for (auto *other : {options.fallback, options.refine}) {
+    if (other && std::find(transcribers.begin(), transcribers.end(), other) ==
+                     transcribers.end()) {
+      transcribers.push_back(other);
+    }
+  }
+  for (auto *used : transcribers) {
+    used->begin_wave(wave->samples, wave->num_samples);
+  }
+
+  auto chunks = plan_chunks(segments, wave, options.gate);
+  // Audio left to transcribe, for the deadline's projection
+  double remaining_audio = 0.0;
+  for (const auto &chunk : chunks) {
+    remaining_audio += (chunk.end_sample - chunk.start_sample) / 16000.0;
+  }
+  double chunk_audio = remaining_audio;
+
+  // Backends that decode several chunks at once get them in batches, in
+  // order, so segments are still added as they're transcribed
+  size_t batch_size = std::max(transcriber.batch_size(), 1);
+  std::vector<ChunkResult> results;
+  int32_t segments_done = 0;
+  for (size_t first = 0; first < chunks.size(); first += batch_size) {
+    size_t n = std::min(batch_size, chunks.size() - first);
+    for (size_t k = 0; k < n; k++) {
+      const auto &chunk = chunks[first + k];
+      remaining_audio -= (chunk.end_sample - chunk.start_sample) / 16000.0;
+    }
+    transcribe_chunks(&transcriber, wave, &chunks[first], n, options,
+                      transcribe_time, remaining_audio, results);
+    for (size_t k = 0; k < n; k++) {
+      int32_t index = chunks[first + k].index;
+      handle_segment(results[k], &json, segments, index, time_map, options,
+                     overlapped[index]);
+      num_chunks++;
+    }
+
+    // Segments before the next chunk's are done, including skipped ones
+    int32_t next = first + n < chunks.size()
+                       ? chunks[first + n].index
+                       : static_cast<int32_t>(segments.size());
+    stage.add(next - segments_done);
+    segments_done = next;
+  }
+  if (chunks.empty()) {
+    stage.add(static_cast<int64_t>(segments.size()));
+  }
+
+  for (auto *used : transcribers) {
+    used->end_wave();
+  }
+  progress::end(stage);
+
+  auto elapsed = std::chrono::duration<float>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count();
+  SPDLOG_INFO("Transcribed {} chunks in {:.1f}s, rtf {:.3f} (backend: {}, "
+              "batch size: {}, dynamic audio ctx: {})",
+              num_chunks, elapsed,
+              chunk_audio > 0.0 ? elapsed / chunk_audio : 0.0,
+              transcriber.name(), batch_size, options.dynamic_audio_ctx);
+  if (options.refine && transcribe_time.drafted_chunks > 0) {
+    // The large model's cost per second of audio, measured on the refined
+    // chunks, applied to all the audio
+    double draft_elapsed =
+        transcribe_time.elapsed - transcribe_time.refine_elapsed;
+    double large_only =
+        transcribe_time.refined_audio_seconds > 0.0
+            ? transcribe_time.audio_seconds * transcribe_time.refine_elapsed /
+                  transcribe_time.refined_audio_seconds
+            : 0.0;
+    SPDLOG_INFO("Refined {}/{} chunks ({:.1f}%), draft {:.1f}s + refine "
+                "{:.1f}s",
+                transcribe_time.refined_chunks, transcribe_time.drafted_chunks,
+                100.0 * transcribe_time.refined_chunks /
+                    transcribe_time.drafted_chunks,
+                draft_elapsed, transcribe_time.refine_elapsed);
+    if (large_only > 0.0 && transcribe_time.elapsed > 0.0) {
+      SPDLOG_INFO("~{:.1f}s with the large model everywhere, {:.2f}x speedup",
+                  large_only, large_only / transcribe_time.elapsed);
+    }
+  }
+  if (options.deadline) {
+    SPDLOG_INFO("Deadline: {}/{} chunks degraded after {} decisions",
+                transcribe_time.degraded_chunks, num_chunks,
+                options.deadline->decisions());
+  }
+  if (options.gate) {
+    const auto &stats = options.gate->stats();
+    SPDLOG_INFO("Speech gate skipped {}/{} segments, {:.1f}s of {:.1f}s, "
+                "scoring took {:.3f}s",
+                stats.skipped, stats.segments, stats.skipped_seconds,
+                stats.seconds, stats.elapsed);
+  }
+  if (options.guard) {
+    log_guard("Decode guard", *options.guard);
+  }
+  if (options.refine_guard) {
+    log_guard("Refine decode guard", *options.refine_guard);
+  }
+  if (options.dedup) {
+    const auto &stats = options.dedup->stats();
+    int32_t lookups = stats.lookups - dedup_before.lookups;
+    int32_t hits = stats.hits - dedup_before.hits;
+    double hit_seconds = stats.hit_seconds - dedup_before.hit_seconds;
+    // Transcription time per second of audio of this run, applied to the hits
+    double saved = transcribe_time.audio_seconds > 0.0
+                       ? hit_seconds * transcribe_time.elapsed /
+                             transcribe_time.audio_seconds
+                       : 0.0;
+    SPDLOG_INFO("Fingerprint index reused {}/{} transcripts ({:.1f}% hit "
+                "rate), {:.1f}s of audio, ~{:.1f}s of transcription time saved",
+                hits, lookups, lookups > 0 ? 100.0 * hits / lookups : 0.0,
+                hit_seconds, saved);
   }
   return json;
 }
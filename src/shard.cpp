@@ -0,0 +1,280 @@
+#include "shard.h"
+#include "embedding.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace shard {
+
+Manifest plan(const std::string &source, float duration, float shard_seconds,
+              float margin) {
+  Manifest manifest;
+  manifest.source = source;
+  manifest.duration = duration;
+  manifest.margin = margin;
+  auto count = std::max(
+      1, static_cast<int32_t>(std::ceil(duration / shard_seconds)));
+  std::string stem = fs::path(source).stem().string();
+  for (int32_t i = 0; i < count; i++) {
+    Shard shard;
+    std::string name = fmt::format("{}_shard_{:03}", stem, i);
+    shard.audio = name + ".wav";
+    shard.json = name + ".json";
+    shard.centroids = name + ".centroids.json";
+    shard.own_start = i * shard_seconds;
+    shard.own_end = i + 1 == count ? duration : (i + 1) * shard_seconds;
+    shard.start = std::max(0.0f, shard.own_start - margin);
+    shard.end = std::min(duration, shard.own_end + margin);
+    manifest.shards.push_back(shard);
+  }
+  return manifest;
+}
+
+bool write(const SherpaOnnxWave *wave, const std::string &dir,
+           const Manifest &manifest) {
+  std::error_code error;
+  fs::create_directories(dir, error);
+  for (const auto &shard : manifest.shards) {
+    auto start = std::min(wave->num_samples,
+                          static_cast<int32_t>(shard.start * 16000));
+    auto end = std::min(wave->num_samples,
+                        static_cast<int32_t>(shard.end * 16000));
+    auto path = (fs::path(dir) / shard.audio).string();
+    if (!SherpaOnnxWriteWave(wave->samples + start, end - start, 16000,
+                             path.c_str())) {
+      SPDLOG_ERROR("Failed to write shard {}", path);
+      return false;
+    }
+  }
+  return save_manifest((fs::path(dir) / "shards.json").string(), manifest);
+}
+
+bool save_manifest(const std::string &path, const Manifest &manifest) {
+  nlohmann::ordered_json shards = nlohmann::ordered_json::array();
+  for (const auto &shard : manifest.shards) {
+    shards.push_back({{"audio", shard.audio},
+                      {"json", shard.json},
+                      {"centroids", shard.centroids},
+                      {"start", shard.start},
+                      {"end", shard.end},
+                      {"own_start", shard.own_start},
+                      {"own_end", shard.own_end}});
+  }
+  nlohmann::ordered_json json = {{"source", manifest.source},
+                                 {"duration", manifest.duration},
+                                 {"margin", manifest.margin},
+                                 {"shards", shards}};
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("Failed to open {} for writing", path);
+    return false;
+  }
+  file << json.dump(4);
+  return file.good();
+}
+
+// Parse the JSON file at path, logging why it can't be
+static bool read_json(const std::string &path, nlohmann::ordered_json &json) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("Failed to open {}", path);
+    return false;
+  }
+  json = nlohmann::ordered_json::parse(file, nullptr, false);
+  if (json.is_discarded()) {
+    SPDLOG_ERROR("{} isn't valid JSON", path);
+    return false;
+  }
+  return true;
+}
+
+bool load_manifest(const std::string &path, Manifest &manifest) {
+  nlohmann::ordered_json json;
+  if (!read_json(path, json)) {
+    return false;
+  }
+  try {
+    manifest.source = json.at("source").get<std::string>();
+    manifest.duration = json.at("duration").get<float>();
+    manifest.margin = json.at("margin").get<float>();
+    manifest.shards.clear();
+    for (const auto &item : json.at("shards")) {
+      Shard shard;
+      shard.audio = item.at("audio").get<std::string>();
+      shard.json = item.at("json").get<std::string>();
+      shard.centroids = item.at("centroids").get<std::string>();
+      shard.start = item.at("start").get<float>();
+      shard.end = item.at("end").get<float>();
+      shard.own_start = item.at("own_start").get<float>();
+      shard.own_end = item.at("own_end").get<float>();
+      manifest.shards.push_back(shard);
+    }
+  } catch (const nlohmann::json::exception &e) {
+    SPDLOG_ERROR("Invalid shard manifest {}: {}", path, e.what());
+    return false;
+  }
+  return true;
+}
+
+bool save_centroids(const std::string &path, const Centroids &centroids) {
+  nlohmann::ordered_json json = nlohmann::ordered_json::object();
+  for (const auto &[speaker, centroid] : centroids) {
+    json[std::to_string(speaker)] = centroid;
+  }
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("Failed to open {} for writing", path);
+    return false;
+  }
+  file << json.dump();
+  return file.good();
+}
+
+bool load_centroids(const std::string &path, Centroids &centroids) {
+  nlohmann::ordered_json json;
+  if (!read_json(path, json)) {
+    return false;
+  }
+  try {
+    centroids.clear();
+    for (const auto &[speaker, centroid] : json.items()) {
+      centroids[std::stoi(speaker)] = centroid.get<std::vector<float>>();
+    }
+  } catch (const std::exception &e) {
+    SPDLOG_ERROR("Invalid centroids {}: {}", path, e.what());
+    return false;
+  }
+  return true;
+}
+
+nlohmann::ordered_json merge(const Manifest &manifest,
+                             const std::vector<nlohmann::ordered_json> &results,
+                             const std::vector<Centroids> &centroids,
+                             float link_threshold, int32_t max_speakers) {
+  // Link shard speakers in time order, like diarization windows are linked
+  std::vector<std::vector<float>> global_centroids;
+  std::vector<int32_t> global_weights;
+  nlohmann::ordered_json merged = nlohmann::ordered_json::array();
+  int32_t dropped = 0;
+  // Shards without any linked speaker get speakers of their own, numbered
+  // -1, -2.. until the linked ones are all known
+  int32_t unlinked = 0;
+  for (size_t i = 0; i < manifest.shards.size(); i++) {
+    const auto &shard = manifest.shards[i];
+    auto mapping = embedding::link_speakers(centroids[i], global_centroids,
+                                            global_weights, link_threshold,
+                                            max_speakers);
+
+    // Speakers without an embedding go to the shard's main speaker
+    std::map<int32_t, float> speech;
+    for (const auto &item : results[i]) {
+      auto it = mapping.find(item["speaker"].get<int32_t>());
+      if (it != mapping.end()) {
+        speech[it->second] +=
+            item["end"].get<float>() - item["start"].get<float>();
+      }
+    }
+    int32_t fallback = 0;
+    float fallback_speech = -1.0f;
+    for (const auto &[global, seconds] : speech) {
+      if (seconds > fallback_speech) {
+        fallback = global;
+        fallback_speech = seconds;
+      }
+    }
+    bool linked = !speech.empty();
+    auto relink = [&](int32_t speaker) {
+      auto it = mapping.find(speaker);
+      if (it != mapping.end()) {
+        return it->second;
+      }
+      if (!linked) {
+        SPDLOG_WARN("No speaker of shard {} has a centroid, its speech goes "
+                    "to a new speaker",
+                    i);
+        fallback = -1 - unlinked++;
+        linked = true;
+      }
+      return fallback;
+    };
+
+    for (auto item : results[i]) {
+      float start = item["start"].get<float>() + shard.start;
+      float end = item["end"].get<float>() + shard.start;
+      // Segments in the margins are the neighbour's
+      float middle = (start + end) / 2.0f;
+      if (middle < shard.own_start || middle >= shard.own_end) {
+        dropped++;
+        continue;
+      }
+      item["start"] = start;
+      item["end"] = end;
+      item["speaker"] = relink(item["speaker"].get<int32_t>());
+      if (item.contains("speakers")) {
+        for (auto &speaker : item["speakers"]) {
+          speaker = relink(speaker.get<int32_t>());
+        }
+      }
+      merged.push_back(std::move(item));
+    }
+  }
+
+  // Number the speakers of unlinked shards after the linked ones
+  auto number = [&](nlohmann::ordered_json &speaker) {
+    int32_t id = speaker.get<int32_t>();
+    if (id < 0) {
+      speaker = static_cast<int32_t>(global_centroids.size()) - 1 - id;
+    }
+  };
+  for (auto &item : merged) {
+    number(item["speaker"]);
+    if (item.contains("speakers")) {
+      for (auto &speaker : item["speakers"]) {
+        number(speaker);
+      }
+    }
+  }
+
+  std::stable_sort(merged.begin(), merged.end(),
+                   [](const auto &a, const auto &b) {
+                     return a["start"].template get<float>() <
+                            b["start"].template get<float>();
+                   });
+  SPDLOG_INFO("Merged {} shards into {} segments of {} speakers, dropped {} "
+              "segments in the margins",
+              manifest.shards.size(), merged.size(),
+              global_centroids.size() + unlinked, dropped);
+  return merged;
+}
+
+bool merge_files(const std::string &path, float link_threshold,
+                 int32_t max_speakers, nlohmann::ordered_json &result) {
+  Manifest manifest;
+  if (!load_manifest(path, manifest)) {
+    return false;
+  }
+  auto dir = fs::path(path).parent_path();
+  std::vector<nlohmann::ordered_json> results(manifest.shards.size());
+  std::vector<Centroids> centroids(manifest.shards.size());
+  for (size_t i = 0; i < manifest.shards.size(); i++) {
+    const auto &shard = manifest.shards[i];
+    if (!read_json((dir / shard.json).string(), results[i]) ||
+        !load_centroids((dir / shard.centroids).string(), centroids[i])) {
+      SPDLOG_ERROR("Shard {} of {} has no result yet", i, path);
+      return false;
+    }
+    if (!results[i].is_array()) {
+      SPDLOG_ERROR("{} isn't a loud JSON result", shard.json);
+      return false;
+    }
+  }
+  result = merge(manifest, results, centroids, link_threshold, max_speakers);
+  return true;
+}
+
+} // namespace shard
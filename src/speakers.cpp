@@ -0,0 +1,266 @@
+#include "speakers.h"
+#include "dsp.h"
+#include "embedding.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace speakers {
+
+static const char magic[8] = {'L', 'O', 'U', 'D', 'S', 'P', 'K', '1'};
+
+// Symmetric per row quantization, returns the scale back to float
+static float quantize(const float *v, int32_t n, int8_t *out) {
+  float max_abs = 0.0f;
+  for (int32_t i = 0; i < n; ++i) {
+    max_abs = std::max(max_abs, std::fabs(v[i]));
+  }
+  float scale = max_abs > 0.0f ? max_abs / 127.0f : 1.0f;
+  for (int32_t i = 0; i < n; ++i) {
+    out[i] = static_cast<int8_t>(std::lround(v[i] / scale));
+  }
+  return scale;
+}
+
+void SpeakerIndex::quantize_row(int32_t index) {
+  scales[index] = quantize(vectors.data() + index * dimension, dimension,
+                           quantized.data() + index * dimension);
+}
+
+bool SpeakerIndex::enroll(const std::string &name,
+                          std::vector<float> embedding) {
+  embedding::normalize(embedding);
+  if (dimension == 0) {
+    dimension = static_cast<int32_t>(embedding.size());
+  }
+  if (static_cast<int32_t>(embedding.size()) != dimension) {
+    std::cerr << "Embedding dimension " << embedding.size()
+              << " doesn't match speaker index dimension " << dimension
+              << std::endl;
+    return false;
+  }
+
+  auto it = rows.find(name);
+  if (it == rows.end()) {
+    rows[name] = static_cast<int32_t>(names.size());
+    names.push_back(name);
+    counts.push_back(1);
+    vectors.insert(vectors.end(), embedding.begin(), embedding.end());
+    scales.push_back(1.0f);
+    quantized.resize(vectors.size());
+    quantize_row(static_cast<int32_t>(names.size()) - 1);
+    return true;
+  }
+
+  // Running mean of all enrollments of the speaker
+  int32_t index = it->second;
+  std::vector<float> merged(vectors.begin() + index * dimension,
+                            vectors.begin() + (index + 1) * dimension);
+  for (int32_t i = 0; i < dimension; ++i) {
+    merged[i] = merged[i] * counts[index] + embedding[i];
+  }
+  embedding::normalize(merged);
+  std::copy(merged.begin(), merged.end(), vectors.begin() + index * dimension);
+  counts[index]++;
+  quantize_row(index);
+  return true;
+}
+
+Match SpeakerIndex::search(const std::vector<float> &query) const {
+  Match best;
+  if (static_cast<int32_t>(query.size()) != dimension) {
+    return best;
+  }
+  std::vector<float> q = query;
+  embedding::normalize(q);
+  for (size_t i = 0; i < names.size(); ++i) {
+    float score = dsp::dot(q.data(), vectors.data() + i * dimension, dimension);
+    if (best.index < 0 || score > best.score) {
+      best.index = static_cast<int32_t>(i);
+      best.score = score;
+    }
+  }
+  return best;
+}
+
+Match SpeakerIndex::search_int8(const std::vector<float> &query) const {
+  Match best;
+  if (static_cast<int32_t>(query.size()) != dimension) {
+    return best;
+  }
+  std::vector<float> q = query;
+  embedding::normalize(q);
+  std::vector<int8_t> q8(dimension);
+  float q_scale = quantize(q.data(), dimension, q8.data());
+
+  for (size_t i = 0; i < names.size(); ++i) {
+    // Rows have different scales, so compare in float
+    int32_t d =
+        dsp::dot_int8(q8.data(), quantized.data() + i * dimension, dimension);
+    float score = d * scales[i] * q_scale;
+    if (best.index < 0 || score > best.score) {
+      best.index = static_cast<int32_t>(i);
+      best.score = score;
+    }
+  }
+  return best;
+}
+
+template <typename T> static void write_pod(std::ofstream &ofs, const T &v) {
+  ofs.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T> static bool read_pod(std::ifstream &ifs, T &v) {
+  ifs.read(reinterpret_cast<char *>(&v), sizeof(T));
+  return static_cast<bool>(ifs);
+}
+
+bool SpeakerIndex::save(const std::string &path) const {
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.is_open()) {
+      std::cerr << "Error: Could not open file for writing: " << path
+                << std::endl;
+      return false;
+    }
+    ofs.write(magic, sizeof(magic));
+    write_pod(ofs, static_cast<uint32_t>(dimension));
+    write_pod(ofs, static_cast<uint32_t>(names.size()));
+    for (size_t i = 0; i < names.size(); ++i) {
+      write_pod(ofs, static_cast<uint32_t>(names[i].size()));
+      ofs.write(names[i].data(), names[i].size());
+      write_pod(ofs, counts[i]);
+    }
+    ofs.write(reinterpret_cast<const char *>(vectors.data()),
+              vectors.size() * sizeof(float));
+    ofs.write(reinterpret_cast<const char *>(scales.data()),
+              scales.size() * sizeof(float));
+    ofs.write(reinterpret_cast<const char *>(quantized.data()),
+              quantized.size());
+    if (!ofs) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec;
+}
+
+bool SpeakerIndex::load(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  char file_magic[sizeof(magic)];
+  ifs.read(file_magic, sizeof(file_magic));
+  if (!ifs || memcmp(file_magic, magic, sizeof(magic)) != 0) {
+    std::cerr << path << " is not a speaker index" << std::endl;
+    return false;
+  }
+
+  // Sizes are checked against the bytes left before allocating, so a
+  // truncated or corrupt index can't ask for gigabytes
+  std::error_code ec;
+  auto file_size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return false;
+  }
+  auto remaining = [&]() {
+    return file_size - static_cast<uint64_t>(ifs.tellg());
+  };
+  // Name size and count, then a row of floats, its scale and int8 copy
+  const uint64_t min_entry_size = 2 * sizeof(uint32_t) + sizeof(float);
+
+  uint32_t dim = 0, count = 0;
+  if (!read_pod(ifs, dim) || !read_pod(ifs, count) ||
+      dim > std::numeric_limits<int32_t>::max() ||
+      (count > 0 &&
+       (count > remaining() / min_entry_size ||
+        dim > remaining() / count / (sizeof(float) + sizeof(int8_t))))) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    return false;
+  }
+  std::vector<std::string> loaded_names(count);
+  std::vector<uint32_t> loaded_counts(count);
+  std::unordered_map<std::string, int32_t> loaded_rows;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t length = 0;
+    if (!read_pod(ifs, length) || length > remaining()) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      return false;
+    }
+    loaded_names[i].resize(length);
+    ifs.read(loaded_names[i].data(), length);
+    if (!read_pod(ifs, loaded_counts[i])) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      return false;
+    }
+    loaded_rows[loaded_names[i]] = static_cast<int32_t>(i);
+  }
+  // Bounded by the check on dim above
+  size_t size = static_cast<size_t>(count) * dim;
+  if (size * (sizeof(float) + sizeof(int8_t)) + count * sizeof(float) >
+      remaining()) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    return false;
+  }
+  std::vector<float> loaded_vectors(size);
+  std::vector<float> loaded_scales(count);
+  std::vector<int8_t> loaded_quantized(size);
+  ifs.read(reinterpret_cast<char *>(loaded_vectors.data()),
+           loaded_vectors.size() * sizeof(float));
+  ifs.read(reinterpret_cast<char *>(loaded_scales.data()),
+           loaded_scales.size() * sizeof(float));
+  ifs.read(reinterpret_cast<char *>(loaded_quantized.data()),
+           loaded_quantized.size());
+  if (!ifs) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    return false;
+  }
+
+  dimension = static_cast<int32_t>(dim);
+  names = std::move(loaded_names);
+  counts = std::move(loaded_counts);
+  rows = std::move(loaded_rows);
+  vectors = std::move(loaded_vectors);
+  scales = std::move(loaded_scales);
+  quantized = std::move(loaded_quantized);
+  return true;
+}
+
+std::map<int32_t, std::string>
+identify(const SpeakerIndex &index,
+         const std::map<int32_t, std::vector<float>> &centroids,
+         float threshold, bool use_int8) {
+  std::map<int32_t, std::string> names;
+  if (index.size() == 0) {
+    return names;
+  }
+
+  for (const auto &[speaker, centroid] : centroids) {
+    auto start = std::chrono::steady_clock::now();
+    Match match =
+        use_int8 ? index.search_int8(centroid) : index.search(centroid);
+    auto elapsed = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    SPDLOG_DEBUG("speaker {} best match {} ({:.3f}) in {:.0f}us over {} "
+                 "enrolled speakers",
+                 speaker, match.index >= 0 ? index.name(match.index) : "-",
+                 match.score, elapsed, index.size());
+    if (match.index >= 0 && match.score >= threshold) {
+      names[speaker] = index.name(match.index);
+    }
+  }
+  return names;
+}
+
+} // namespace speakers
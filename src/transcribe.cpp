@@ -1,4 +1,6 @@
+#include "transcribe.h"
 #include "ggml.h"
+#include <algorithm>
 #include <iostream>
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -53,9 +55,51 @@ whisper_full_params create_whisper_params(std::string &language) {
   return wparams;
 }
 
+int audio_ctx_for_samples(int n_samples) {
+  const int max_ctx = 1500;
+  const int bucket = 128;
+  const int margin = 64; // ~1.3 seconds
+  const int min_ctx = 256;
+
+  int ctx = (n_samples + samples_per_audio_ctx - 1) / samples_per_audio_ctx;
+  ctx = ((ctx + margin + bucket - 1) / bucket) * bucket;
+  return std::clamp(ctx, min_ctx, max_ctx);
+}
+
+float compression_ratio(const std::string &text) {
+  // Matches are a 12 bit offset and a length, about 3 bytes like deflate's
+  const size_t window = 4096;
+  const size_t min_match = 3;
+  const size_t match_cost = 3;
+  if (text.empty()) {
+    return 0.0f;
+  }
+  size_t encoded = 0;
+  size_t i = 0;
+  while (i < text.size()) {
+    size_t longest = 0;
+    for (size_t j = i > window ? i - window : 0; j < i; j++) {
+      size_t length = 0;
+      while (i + length < text.size() && text[j + length] == text[i + length]) {
+        length++;
+      }
+      longest = std::max(longest, length);
+    }
+    if (longest >= min_match) {
+      encoded += match_cost;
+      i += longest;
+    } else {
+      encoded++;
+      i++;
+    }
+  }
+  return static_cast<float>(text.size()) / encoded;
+}
+
 std::string transcribe_audio_chunk(whisper_context *ctx,
                                    const whisper_full_params &params,
-                                   const float *samples, int n_samples) {
+                                   const float *samples, int n_samples,
+                                   Confidence *confidence) {
   // Process the chunk with Whisper
   if (whisper_full(ctx, params, samples, n_samples) != 0) {
     std::cerr << "Failed to process audio chunk." << std::endl;
@@ -73,6 +117,26 @@ std::string transcribe_audio_chunk(whisper_context *ctx,
     transcription << segment_text << " ";
   }
 
+  if (confidence) {
+    // Timestamps, language and other special tokens come after eot
+    const whisper_token eot = whisper_token_eot(ctx);
+    double sum = 0.0;
+    int n_tokens = 0;
+    for (int j = 0; j < n_segments; j++) {
+      for (int t = 0; t < whisper_full_n_tokens(ctx, j); t++) {
+        auto token = whisper_full_get_token_data(ctx, j, t);
+        if (token.id >= eot) {
+          continue;
+        }
+        sum += token.plog;
+        n_tokens++;
+      }
+    }
+    confidence->avg_logprob =
+        n_tokens > 0 ? static_cast<float>(sum / n_tokens) : 0.0f;
+    confidence->compression_ratio = compression_ratio(transcription.str());
+  }
+
   return transcription.str();
 }
 
@@ -0,0 +1,330 @@
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+
+#include "transcriber.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace transcriber {
+
+std::vector<std::string> Transcriber::transcribe_batch(
+    const std::vector<Samples> &chunks, const ChunkOptions &options,
+    std::vector<transcribe::Confidence> *confidences) {
+  std::vector<std::string> texts;
+  if (confidences) {
+    confidences->assign(chunks.size(), {});
+  }
+  for (size_t i = 0; i < chunks.size(); i++) {
+    texts.push_back(transcribe(chunks[i].samples, chunks[i].n_samples, options,
+                               confidences ? &(*confidences)[i] : nullptr));
+  }
+  return texts;
+}
+
+std::unique_ptr<WhisperTranscriber>
+WhisperTranscriber::create(const std::string &model_path,
+                           const std::string &language, bool shared_mel) {
+  const auto cparams = whisper_context_default_params();
+  auto *ctx = whisper_init_from_file_with_params(model_path.c_str(), cparams);
+  if (!ctx) {
+    SPDLOG_ERROR("Failed to load whisper model {}", model_path);
+    return nullptr;
+  }
+  auto transcriber = std::unique_ptr<WhisperTranscriber>(
+      new WhisperTranscriber(ctx, language, shared_mel));
+  // The shared spectrogram goes through the model's own filters, like
+  // whisper's. Models converted without them get the ones OpenAI's use
+  if (shared_mel && !mel::load_filters(model_path, whisper_model_n_mels(ctx),
+                                       transcriber->mel_filters)) {
+    SPDLOG_WARN("No mel filters found in {}, using Slaney filters for "
+                "--shared-mel",
+                model_path);
+  }
+  return transcriber;
+}
+
+WhisperTranscriber::WhisperTranscriber(whisper_context *ctx,
+                                       const std::string &language,
+                                       bool shared_mel)
+    : ctx(ctx), language(language),
+      params(transcribe::create_whisper_params(this->language)),
+      shared_mel(shared_mel) {}
+
+WhisperTranscriber::~WhisperTranscriber() { whisper_free(ctx); }
+
+std::string WhisperTranscriber::transcribe(const float *samples,
+                                           int n_samples,
+                                           const ChunkOptions &options,
+                                           transcribe::Confidence *confidence) {
+  // Zero padded to the full 30 seconds window, in dynamic mode only up to
+  // the bucketed encoder context that's used for it
+  auto chunk_params = params;
+  size_t padded_size = 16000 * 30;
+  if (options.dynamic_audio_ctx) {
+    chunk_params.audio_ctx = transcribe::audio_ctx_for_samples(n_samples);
+    padded_size = static_cast<size_t>(chunk_params.audio_ctx) *
+                  transcribe::samples_per_audio_ctx;
+  }
+  if (!options.temperature_fallback) {
+    chunk_params.temperature_inc = 0.0f;
+  }
+  if (options.guard) {
+    options.guard->begin_chunk(chunk_params, n_samples / 16000.0);
+  }
+
+  std::string text;
+  std::less_equal<const float *> before;
+  if (shared_mel && wave_samples && before(wave_samples, samples) &&
+      before(samples + n_samples, wave_samples + wave_size)) {
+    if (!spectrogram) {
+      auto start_time = std::chrono::steady_clock::now();
+      spectrogram = std::make_unique<mel::Spectrogram>(
+          wave_samples, wave_size, whisper_model_n_mels(ctx),
+          chunk_params.n_threads, mel_filters);
+      SPDLOG_DEBUG("Computed the log mel spectrogram of {:.1f}s in {:.2f}s",
+                   wave_size / 16000.0,
+                   std::chrono::duration<float>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count());
+    }
+    // The padded chunk, then the 30 seconds of silence whisper adds to
+    // what it's given. Only the padded chunk is decoded
+    auto start = static_cast<int32_t>(samples - wave_samples);
+    int32_t chunk_frames =
+        static_cast<int32_t>(padded_size / mel::hop_length);
+    int32_t num_frames = chunk_frames + 30 * 16000 / mel::hop_length;
+    spectrogram->slice(start, start + n_samples, num_frames, mel_slice);
+    chunk_params.duration_ms = chunk_frames * 10;
+    if (whisper_set_mel(ctx, mel_slice.data(), num_frames,
+                        spectrogram->n_mel()) == 0) {
+      text = transcribe::transcribe_audio_chunk(ctx, chunk_params, nullptr, 0,
+                                                confidence);
+    } else {
+      SPDLOG_ERROR("Failed to set the mel spectrogram of a chunk");
+    }
+  } else {
+    std::vector<float> data(samples, samples + n_samples);
+    if (data.size() < padded_size) {
+      data.resize(padded_size, 0.0f);
+    }
+    text = transcribe::transcribe_audio_chunk(ctx, chunk_params, data.data(),
+                                              static_cast<int>(data.size()),
+                                              confidence);
+  }
+  if (options.guard) {
+    auto stopped = options.guard->end_chunk();
+    if (confidence) {
+      confidence->stopped = stopped;
+    }
+  }
+  return text;
+}
+
+// First file in dir named one of names, or ending with "-" and one of them
+// as sherpa's whisper exports do (tiny.en-encoder.onnx). Names are in order
+// of preference
+static std::string find_model_file(const std::string &dir,
+                                   const std::vector<std::string> &names) {
+  std::vector<std::string> files;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(dir, ec)) {
+    files.push_back(entry.path().filename().string());
+  }
+  std::sort(files.begin(), files.end());
+  for (const auto &name : names) {
+    for (const auto &file : files) {
+      bool suffix = file.size() > name.size() &&
+                    file.compare(file.size() - name.size() - 1,
+                                 std::string::npos, "-" + name) == 0;
+      if (file == name || suffix) {
+        return (fs::path(dir) / file).string();
+      }
+    }
+  }
+  return "";
+}
+
+std::unique_ptr<SherpaTranscriber>
+SherpaTranscriber::create(const SherpaConfig &config) {
+  const auto &dir = config.model_dir;
+  auto tokens = find_model_file(dir, {"tokens.txt"});
+  std::string language = config.language.empty() ? "auto" : config.language;
+  // Model files, keep the strings alive until the recognizer is created
+  std::vector<std::string> files;
+  if (config.model_type == "sense_voice" || config.model_type == "paraformer") {
+    files = {find_model_file(dir, {"model.int8.onnx", "model.onnx"})};
+  } else if (config.model_type == "moonshine") {
+    files = {find_model_file(dir, {"preprocess.onnx"}),
+             find_model_file(dir, {"encode.int8.onnx", "encode.onnx"}),
+             find_model_file(dir, {"uncached_decode.int8.onnx",
+                                   "uncached_decode.onnx"}),
+             find_model_file(dir, {"cached_decode.int8.onnx",
+                                   "cached_decode.onnx"})};
+  } else if (config.model_type == "whisper") {
+    files = {find_model_file(dir, {"encoder.int8.onnx", "encoder.onnx"}),
+             find_model_file(dir, {"decoder.int8.onnx", "decoder.onnx"})};
+    // Sherpa's whisper takes no language to detect it
+    if (language == "auto") {
+      language.clear();
+    }
+  } else {
+    SPDLOG_ERROR("Unknown sherpa model type {}", config.model_type);
+    return nullptr;
+  }
+  if (tokens.empty() ||
+      std::find(files.begin(), files.end(), "") != files.end()) {
+    SPDLOG_ERROR("Missing {} model files or tokens.txt in {}",
+                 config.model_type, dir);
+    return nullptr;
+  }
+
+  SherpaOnnxOfflineRecognizerConfig recognizer_config;
+  memset(&recognizer_config, 0, sizeof(recognizer_config));
+  recognizer_config.feat_config.sample_rate = 16000;
+  recognizer_config.feat_config.feature_dim = 80;
+  recognizer_config.decoding_method = "greedy_search";
+  auto &model_config = recognizer_config.model_config;
+  model_config.tokens = tokens.c_str();
+  model_config.num_threads = config.num_threads;
+  model_config.provider = config.provider.c_str();
+  if (config.model_type == "sense_voice") {
+    model_config.sense_voice.model = files[0].c_str();
+    model_config.sense_voice.language = language.c_str();
+    model_config.sense_voice.use_itn = 1;
+  } else if (config.model_type == "paraformer") {
+    model_config.paraformer.model = files[0].c_str();
+  } else if (config.model_type == "moonshine") {
+    model_config.moonshine.preprocessor = files[0].c_str();
+    model_config.moonshine.encoder = files[1].c_str();
+    model_config.moonshine.uncached_decoder = files[2].c_str();
+    model_config.moonshine.cached_decoder = files[3].c_str();
+  } else {
+    model_config.whisper.encoder = files[0].c_str();
+    model_config.whisper.decoder = files[1].c_str();
+    model_config.whisper.language = language.c_str();
+    model_config.whisper.task = "transcribe";
+  }
+
+  auto *recognizer = SherpaOnnxCreateOfflineRecognizer(&recognizer_config);
+  if (!recognizer) {
+    SPDLOG_ERROR("Failed to load sherpa {} model from {}", config.model_type,
+                 dir);
+    return nullptr;
+  }
+  return std::unique_ptr<SherpaTranscriber>(
+      new SherpaTranscriber(recognizer, std::max(config.batch_size, 1)));
+}
+
+SherpaTranscriber::SherpaTranscriber(
+    const SherpaOnnxOfflineRecognizer *recognizer, int32_t batch)
+    : recognizer(recognizer), batch(batch) {}
+
+SherpaTranscriber::~SherpaTranscriber() {
+  SherpaOnnxDestroyOfflineRecognizer(recognizer);
+}
+
+std::string SherpaTranscriber::transcribe(const float *samples, int n_samples,
+                                          const ChunkOptions &options,
+                                          transcribe::Confidence *confidence) {
+  std::vector<transcribe::Confidence> confidences;
+  auto texts = transcribe_batch({{samples, n_samples}}, options,
+                                confidence ? &confidences : nullptr);
+  if (confidence) {
+    *confidence = confidences[0];
+  }
+  return texts[0];
+}
+
+std::vector<std::string> SherpaTranscriber::transcribe_batch(
+    const std::vector<Samples> &chunks, const ChunkOptions &options,
+    std::vector<transcribe::Confidence> *confidences) {
+  std::vector<const SherpaOnnxOfflineStream *> streams;
+  for (const auto &chunk : chunks) {
+    auto *stream = SherpaOnnxCreateOfflineStream(recognizer);
+    SherpaOnnxAcceptWaveformOffline(stream, 16000, chunk.samples,
+                                    chunk.n_samples);
+    streams.push_back(stream);
+  }
+  SherpaOnnxDecodeMultipleOfflineStreams(
+      recognizer, streams.data(), static_cast<int32_t>(streams.size()));
+
+  std::vector<std::string> texts;
+  for (auto *stream : streams) {
+    const auto *result = SherpaOnnxGetOfflineStreamResult(stream);
+    // Spaced like whisper's transcripts
+    std::string text = result && result->text && result->text[0]
+                           ? std::string(" ") + result->text + " "
+                           : "";
+    texts.push_back(text);
+    SherpaOnnxDestroyOfflineRecognizerResult(result);
+    SherpaOnnxDestroyOfflineStream(stream);
+  }
+  if (confidences) {
+    confidences->clear();
+    for (const auto &text : texts) {
+      confidences->push_back({0.0f, transcribe::compression_ratio(text)});
+    }
+  }
+  return texts;
+}
+
+void WhisperTranscriber::begin_wave(const float *samples, int n_samples) {
+  wave_samples = samples;
+  wave_size = n_samples;
+  spectrogram.reset();
+}
+
+void WhisperTranscriber::end_wave() {
+  wave_samples = nullptr;
+  wave_size = 0;
+  spectrogram.reset();
+}
+
+void mock_sleep(const MockConfig &config, double audio_seconds) {
+  double seconds = config.latency + config.rtf * audio_seconds;
+  if (seconds > 0.0) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  }
+}
+
+std::string MockTranscriber::transcribe(const float *samples, int n_samples,
+                                        const ChunkOptions &options,
+                                        transcribe::Confidence *confidence) {
+  static const char *words[] = {"the",     "audio",  "of",     "this",
+                                "meeting", "is",     "a",      "mock",
+                                "speaker", "said",   "that",   "we",
+                                "should",  "ship",   "it",     "today"};
+  const size_t num_words = sizeof(words) / sizeof(words[0]);
+  double audio_seconds = n_samples / 16000.0;
+  mock_sleep(config, audio_seconds);
+
+  // FNV-1a over the sample bits
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < n_samples; i++) {
+    uint32_t bits;
+    std::memcpy(&bits, &samples[i], sizeof(bits));
+    hash = (hash ^ bits) * 1099511628211ull;
+  }
+  // About as many words as people speak
+  auto count = static_cast<int>(audio_seconds * 2.5) + 1;
+  std::ostringstream text;
+  for (int i = 0; i < count; i++) {
+    text << " " << words[hash % num_words];
+    hash = hash * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  if (confidence) {
+    confidence->avg_logprob = -0.3f;
+    confidence->compression_ratio = transcribe::compression_ratio(text.str());
+  }
+  return text.str();
+}
+
+} // namespace transcriber
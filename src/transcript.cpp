@@ -0,0 +1,437 @@
+#include "transcript.h"
+#include "spdlog/spdlog.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace transcript {
+
+static const char magic[8] = {'L', 'O', 'U', 'D', 'T', 'R', 'N', '2'};
+
+// Byte offsets of the columns from the start of the file, each 8 byte
+// aligned. Heap offset columns have one more entry than they index, where
+// the last string ends. The end tree is an implicit binary tree of the
+// maximum end over ranges of start order, with its leaves from tree_leaves
+struct Header {
+  char magic[8];
+  uint32_t num_segments;
+  uint32_t num_names;
+  uint64_t starts;
+  uint64_t ends;
+  uint64_t speakers;
+  uint64_t names;
+  uint64_t text_offsets;
+  uint64_t extra_offsets;
+  uint64_t order;
+  uint64_t max_ends;
+  uint64_t name_offsets;
+  uint64_t heap;
+  uint64_t heap_size;
+  uint64_t end_tree;
+  uint64_t tree_leaves;
+};
+
+// Keys of the columns, anything else goes to extra
+static bool is_column(const std::string &key) {
+  return key == "text" || key == "start" || key == "end" ||
+         key == "speaker" || key == "speaker_name";
+}
+
+class Writer {
+public:
+  template <typename T> uint64_t column(const std::vector<T> &values) {
+    buffer.resize((buffer.size() + 7) / 8 * 8, '\0');
+    uint64_t offset = buffer.size();
+    const char *bytes = reinterpret_cast<const char *>(values.data());
+    buffer.insert(buffer.end(), bytes, bytes + values.size() * sizeof(T));
+    return offset;
+  }
+
+  std::vector<char> buffer = std::vector<char>(sizeof(Header), '\0');
+};
+
+bool save(const std::string &path, const nlohmann::ordered_json &result) {
+  auto n = static_cast<uint32_t>(result.size());
+  std::vector<float> starts(n);
+  std::vector<float> ends(n);
+  std::vector<int32_t> speakers(n);
+  std::vector<int32_t> names(n, -1);
+  std::vector<uint32_t> text_offsets;
+  std::vector<uint32_t> extra_offsets;
+  std::vector<uint32_t> name_offsets;
+  std::string heap;
+  std::map<std::string, int32_t> name_ids;
+  std::vector<std::string> unique_names;
+
+  for (uint32_t i = 0; i < n; i++) {
+    const auto &item = result[i];
+    try {
+      starts[i] = item.at("start").get<float>();
+      ends[i] = item.at("end").get<float>();
+      speakers[i] = item.at("speaker").get<int32_t>();
+      if (item.contains("speaker_name")) {
+        auto name = item["speaker_name"].get<std::string>();
+        auto [it, added] =
+            name_ids.emplace(name, static_cast<int32_t>(name_ids.size()));
+        if (added) {
+          unique_names.push_back(name);
+        }
+        names[i] = it->second;
+      }
+      text_offsets.push_back(static_cast<uint32_t>(heap.size()));
+      heap += item.at("text").get<std::string>();
+    } catch (const nlohmann::json::exception &e) {
+      SPDLOG_ERROR("Invalid segment {} of the result: {}", i, e.what());
+      return false;
+    }
+
+    nlohmann::ordered_json extra = nlohmann::ordered_json::object();
+    for (const auto &[key, value] : item.items()) {
+      if (!is_column(key)) {
+        extra[key] = value;
+      }
+    }
+    extra_offsets.push_back(static_cast<uint32_t>(heap.size()));
+    if (!extra.empty()) {
+      heap += extra.dump();
+    }
+  }
+  // Each text ends at its extra, each extra at the next text
+  text_offsets.push_back(static_cast<uint32_t>(heap.size()));
+  extra_offsets.push_back(static_cast<uint32_t>(heap.size()));
+  for (const auto &name : unique_names) {
+    name_offsets.push_back(static_cast<uint32_t>(heap.size()));
+    heap += name;
+  }
+  name_offsets.push_back(static_cast<uint32_t>(heap.size()));
+  if (heap.size() > UINT32_MAX) {
+    SPDLOG_ERROR("Transcript text is too large for {}", path);
+    return false;
+  }
+
+  std::vector<uint32_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return starts[a] < starts[b];
+  });
+  std::vector<float> max_ends(n);
+  float max_end = 0.0f;
+  for (uint32_t i = 0; i < n; i++) {
+    max_end = i == 0 ? ends[order[i]] : std::max(max_end, ends[order[i]]);
+    max_ends[i] = max_end;
+  }
+
+  // Leaves past the last segment never reach any time
+  uint64_t tree_leaves = 1;
+  while (tree_leaves < n) {
+    tree_leaves *= 2;
+  }
+  if (tree_leaves > UINT32_MAX / 2) {
+    SPDLOG_ERROR("Transcript has too many segments for {}", path);
+    return false;
+  }
+  std::vector<float> end_tree(2 * tree_leaves,
+                              -std::numeric_limits<float>::infinity());
+  for (uint32_t i = 0; i < n; i++) {
+    end_tree[tree_leaves + i] = ends[order[i]];
+  }
+  for (uint64_t node = tree_leaves - 1; node > 0; node--) {
+    end_tree[node] = std::max(end_tree[2 * node], end_tree[2 * node + 1]);
+  }
+
+  Writer writer;
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.num_segments = n;
+  header.num_names = static_cast<uint32_t>(name_ids.size());
+  header.starts = writer.column(starts);
+  header.ends = writer.column(ends);
+  header.speakers = writer.column(speakers);
+  header.names = writer.column(names);
+  header.text_offsets = writer.column(text_offsets);
+  header.extra_offsets = writer.column(extra_offsets);
+  header.order = writer.column(order);
+  header.max_ends = writer.column(max_ends);
+  header.name_offsets = writer.column(name_offsets);
+  header.heap = writer.column(std::vector<char>(heap.begin(), heap.end()));
+  header.heap_size = heap.size();
+  header.end_tree = writer.column(end_tree);
+  header.tree_leaves = tree_leaves;
+  std::memcpy(writer.buffer.data(), &header, sizeof(header));
+
+  // Unique, so concurrent writers of path don't write into the same file
+  std::string tmp_path = path + "." + utils::get_random_string(8) + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    if (!ofs.is_open()) {
+      std::cerr << "Error: Could not open file for writing: " << path
+                << std::endl;
+      return false;
+    }
+    ofs.write(writer.buffer.data(),
+              static_cast<std::streamsize>(writer.buffer.size()));
+    if (!ofs) {
+      ofs.close();
+      std::filesystem::remove(tmp_path);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+Reader::~Reader() { close(); }
+
+void Reader::close() {
+#ifdef _WIN32
+  if (data) {
+    UnmapViewOfFile(data);
+  }
+  if (mapping) {
+    CloseHandle(mapping);
+  }
+  if (file) {
+    CloseHandle(file);
+  }
+  file = nullptr;
+  mapping = nullptr;
+#else
+  if (data) {
+    munmap(const_cast<char *>(data), length);
+  }
+#endif
+  data = nullptr;
+  length = 0;
+  header = nullptr;
+  end_tree = nullptr;
+  tree_leaves = 0;
+}
+
+bool Reader::open(const std::string &path) {
+  close();
+#ifdef _WIN32
+  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    close();
+    return false;
+  }
+  length = static_cast<size_t>(size.QuadPart);
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping) {
+    data = static_cast<const char *>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    length = static_cast<size_t>(st.st_size);
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    data = mapped == MAP_FAILED ? nullptr : static_cast<const char *>(mapped);
+  }
+  ::close(fd);
+#endif
+  if (!data) {
+    close();
+    return false;
+  }
+
+  if (length < sizeof(Header) ||
+      std::memcmp(data, magic, sizeof(magic)) != 0) {
+    std::cerr << path << " is not a transcript" << std::endl;
+    close();
+    return false;
+  }
+  header = reinterpret_cast<const Header *>(data);
+  uint64_t n = header->num_segments;
+  uint64_t num_names = header->num_names;
+  // A power of two with a leaf for every segment
+  uint64_t leaves = header->tree_leaves;
+  if (leaves < std::max<uint64_t>(n, 1) || leaves > UINT32_MAX / 2 ||
+      (leaves & (leaves - 1)) != 0) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    close();
+    return false;
+  }
+  // Every column has to fit in the file
+  const std::pair<uint64_t, uint64_t> columns[] = {
+      {header->starts, n * sizeof(float)},
+      {header->ends, n * sizeof(float)},
+      {header->speakers, n * sizeof(int32_t)},
+      {header->names, n * sizeof(int32_t)},
+      {header->text_offsets, (n + 1) * sizeof(uint32_t)},
+      {header->extra_offsets, (n + 1) * sizeof(uint32_t)},
+      {header->order, n * sizeof(uint32_t)},
+      {header->max_ends, n * sizeof(float)},
+      {header->name_offsets, (num_names + 1) * sizeof(uint32_t)},
+      {header->heap, header->heap_size},
+      {header->end_tree, 2 * leaves * sizeof(float)},
+  };
+  for (const auto &[offset, size] : columns) {
+    if (offset % 4 != 0 || offset > length || size > length - offset) {
+      std::cerr << path << " is truncated or corrupt" << std::endl;
+      close();
+      return false;
+    }
+  }
+
+  starts = reinterpret_cast<const float *>(data + header->starts);
+  ends = reinterpret_cast<const float *>(data + header->ends);
+  speakers = reinterpret_cast<const int32_t *>(data + header->speakers);
+  names = reinterpret_cast<const int32_t *>(data + header->names);
+  text_offsets =
+      reinterpret_cast<const uint32_t *>(data + header->text_offsets);
+  extra_offsets =
+      reinterpret_cast<const uint32_t *>(data + header->extra_offsets);
+  order = reinterpret_cast<const uint32_t *>(data + header->order);
+  max_ends = reinterpret_cast<const float *>(data + header->max_ends);
+  name_offsets =
+      reinterpret_cast<const uint32_t *>(data + header->name_offsets);
+  heap = data + header->heap;
+
+  end_tree = reinterpret_cast<const float *>(data + header->end_tree);
+  tree_leaves = static_cast<uint32_t>(leaves);
+  return true;
+}
+
+uint32_t Reader::size() const { return header ? header->num_segments : 0; }
+
+// A string from its offset to the next one, empty if the offsets are corrupt
+static std::string_view heap_range(const char *heap, uint64_t heap_size,
+                                   uint32_t begin, uint32_t end) {
+  if (begin > end || end > heap_size) {
+    return {};
+  }
+  return {heap + begin, end - begin};
+}
+
+std::string_view Reader::heap_string(const uint32_t *offsets,
+                                     uint32_t index) const {
+  return heap_range(heap, header->heap_size, offsets[index],
+                    offsets[index + 1]);
+}
+
+Segment Reader::segment(uint32_t index) const {
+  Segment segment;
+  segment.start = starts[index];
+  segment.end = ends[index];
+  segment.speaker = speakers[index];
+  int32_t name = names[index];
+  if (name >= 0 && static_cast<uint32_t>(name) < header->num_names) {
+    segment.speaker_name = heap_string(name_offsets, name);
+  }
+  // Text runs up to the segment's extra, extra up to the next text
+  segment.text = heap_range(heap, header->heap_size, text_offsets[index],
+                            extra_offsets[index]);
+  segment.extra = heap_range(heap, header->heap_size, extra_offsets[index],
+                             text_offsets[index + 1]);
+  return segment;
+}
+
+std::vector<uint32_t> Reader::at(float seconds) const {
+  std::vector<uint32_t> found;
+  uint32_t n = size();
+  // First position in start order that starts after seconds
+  uint32_t low = 0;
+  uint32_t high = n;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    uint32_t index = order[mid];
+    if (index < n && starts[index] <= seconds) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  // Segments before the first whose running maximum end passes seconds
+  // all ended before it
+  uint32_t first = 0;
+  high = low;
+  while (first < high) {
+    uint32_t mid = first + (high - first) / 2;
+    if (max_ends[mid] > seconds) {
+      high = mid;
+    } else {
+      first = mid + 1;
+    }
+  }
+  if (first < low) {
+    collect(1, 0, tree_leaves, first, low, seconds, found);
+  }
+  return found;
+}
+
+// Segments of positions begin to end in start order that end after seconds,
+// descending only into subtrees reaching past it
+void Reader::collect(uint32_t node, uint32_t node_begin, uint32_t node_end,
+                     uint32_t begin, uint32_t end, float seconds,
+                     std::vector<uint32_t> &found) const {
+  if (node_end <= begin || node_begin >= end || end_tree[node] <= seconds) {
+    return;
+  }
+  if (node >= tree_leaves) {
+    uint32_t index = order[node - tree_leaves];
+    if (index < size()) {
+      found.push_back(index);
+    }
+    return;
+  }
+  uint32_t middle = node_begin + (node_end - node_begin) / 2;
+  collect(2 * node, node_begin, middle, begin, end, seconds, found);
+  collect(2 * node + 1, middle, node_end, begin, end, seconds, found);
+}
+
+nlohmann::ordered_json Reader::to_json() const {
+  auto result = nlohmann::ordered_json::array();
+  for (uint32_t i = 0; i < size(); i++) {
+    auto segment = this->segment(i);
+    nlohmann::ordered_json item = {{"text", std::string(segment.text)},
+                                   {"start", segment.start},
+                                   {"end", segment.end},
+                                   {"speaker", segment.speaker}};
+    if (!segment.speaker_name.empty()) {
+      item["speaker_name"] = std::string(segment.speaker_name);
+    }
+    if (!segment.extra.empty()) {
+      auto extra = nlohmann::ordered_json::parse(segment.extra, nullptr,
+                                                 false);
+      if (extra.is_object()) {
+        item.update(extra);
+      }
+    }
+    result.push_back(item);
+  }
+  return result;
+}
+
+} // namespace transcript
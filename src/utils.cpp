@@ -14,7 +14,14 @@
 #include <subprocess.hpp>
 
 #ifdef PLATFORM_UNIX
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
 #endif
 
 namespace fs = std::filesystem;
@@ -96,8 +103,12 @@ bool check_resource_exists(const std::string &resource_path, int argc,
                            char *argv[]) {
   if (!fs::exists(resource_path)) {
     std::cout << "File " << " not found at " << resource_path << std::endl
-              << std::endl
-              << "Please execute the following command to download models "
+              << std::endl;
+    if (fs::exists(resource_path + ".part")) {
+      std::cout << "A partial download was found at " << resource_path
+                << ".part and will be resumed." << std::endl;
+    }
+    std::cout << "Please execute the following command to download models "
                  "automatically:"
               << std::endl
               << utils::get_argv_line(argc, argv) << " --setup" << std::endl;
@@ -153,4 +164,43 @@ void set_executable(const std::string &file_path) {
 #endif
 }
 
+FileLock::FileLock(const std::string &path) {
+  std::string lock_path = path + ".lock";
+#ifdef _WIN32
+  HANDLE file = CreateFileA(lock_path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return;
+  }
+  handle = file;
+  OVERLAPPED overlapped = {};
+  is_locked = LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD,
+                         &overlapped);
+#else
+  fd = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return;
+  }
+  is_locked = flock(fd, LOCK_EX) == 0;
+#endif
+}
+
+FileLock::~FileLock() {
+#ifdef _WIN32
+  if (handle) {
+    if (is_locked) {
+      OVERLAPPED overlapped = {};
+      UnlockFileEx(handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+    }
+    CloseHandle(handle);
+  }
+#else
+  if (fd >= 0) {
+    // Closing releases the lock
+    close(fd);
+  }
+#endif
+}
+
 } // namespace utils
\ No newline at end of file
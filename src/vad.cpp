@@ -0,0 +1,118 @@
+#include "vad.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace vad {
+
+float CompactAudio::to_original(float seconds, bool is_end) const {
+  if (regions.empty()) {
+    return seconds;
+  }
+  int32_t sample = static_cast<int32_t>(seconds * 16000);
+
+  // Last region starting before (or at, for start timestamps) the sample
+  auto it = std::upper_bound(regions.begin(), regions.end(), sample,
+                             [is_end](int32_t value, const Region &region) {
+                               return is_end ? value <= region.compact_start
+                                             : value < region.compact_start;
+                             });
+  if (it != regions.begin()) {
+    --it;
+  }
+  int32_t offset = std::clamp(sample - it->compact_start, 0, it->length);
+  return static_cast<float>(it->original_start + offset) / 16000;
+}
+
+float CompactAudio::skipped_fraction() const {
+  if (original_num_samples == 0) {
+    return 0.0f;
+  }
+  return 1.0f - static_cast<float>(samples.size()) / original_num_samples;
+}
+
+std::unique_ptr<CompactAudio> compact_speech(const SherpaOnnxWave *wave,
+                                             const VadConfig &config) {
+  SherpaOnnxVadModelConfig vad_config;
+  memset(&vad_config, 0, sizeof(vad_config));
+  vad_config.silero_vad.model = config.model_path.c_str();
+  vad_config.silero_vad.threshold = config.threshold;
+  vad_config.silero_vad.min_silence_duration = config.min_silence_duration;
+  vad_config.silero_vad.min_speech_duration = config.min_speech_duration;
+  vad_config.silero_vad.window_size = 512;
+  vad_config.silero_vad.max_speech_duration = 30.0f;
+  vad_config.sample_rate = 16000;
+  vad_config.num_threads = config.onnx_num_threads;
+  vad_config.provider = config.provider.c_str();
+
+  auto *vad = SherpaOnnxCreateVoiceActivityDetector(&vad_config, 60);
+  if (!vad) {
+    std::cerr << "Failed to initialize voice activity detector" << std::endl;
+    return nullptr;
+  }
+
+  // Collect speech regions padded with some context
+  int32_t padding = static_cast<int32_t>(config.padding * 16000);
+  std::vector<std::pair<int32_t, int32_t>> speech;
+  auto drain = [&]() {
+    while (!SherpaOnnxVoiceActivityDetectorEmpty(vad)) {
+      const auto *segment = SherpaOnnxVoiceActivityDetectorFront(vad);
+      int32_t start = std::max(0, segment->start - padding);
+      int32_t end =
+          std::min(wave->num_samples, segment->start + segment->n + padding);
+      if (!speech.empty() && start <= speech.back().second) {
+        speech.back().second = std::max(speech.back().second, end);
+      } else {
+        speech.emplace_back(start, end);
+      }
+      SherpaOnnxDestroySpeechSegment(segment);
+      SherpaOnnxVoiceActivityDetectorPop(vad);
+    }
+  };
+
+  const int32_t window_size = vad_config.silero_vad.window_size;
+  int32_t i = 0;
+  for (; i + window_size <= wave->num_samples; i += window_size) {
+    SherpaOnnxVoiceActivityDetectorAcceptWaveform(vad, wave->samples + i,
+                                                  window_size);
+    drain();
+  }
+  // Zero pad the last partial window so speech up to the end is detected.
+  // Regions are clamped to the real samples by drain
+  if (i < wave->num_samples) {
+    std::vector<float> tail(window_size, 0.0f);
+    std::copy(wave->samples + i, wave->samples + wave->num_samples,
+              tail.begin());
+    SherpaOnnxVoiceActivityDetectorAcceptWaveform(vad, tail.data(),
+                                                  window_size);
+    drain();
+  }
+  SherpaOnnxVoiceActivityDetectorFlush(vad);
+  drain();
+  SherpaOnnxDestroyVoiceActivityDetector(vad);
+
+  auto audio = std::make_unique<CompactAudio>();
+  audio->original_num_samples = wave->num_samples;
+  for (const auto &[start, end] : speech) {
+    Region region;
+    region.compact_start = static_cast<int32_t>(audio->samples.size());
+    region.original_start = start;
+    region.length = end - start;
+    audio->regions.push_back(region);
+    audio->samples.insert(audio->samples.end(), wave->samples + start,
+                          wave->samples + end);
+  }
+
+  audio->wave.samples = audio->samples.data();
+  audio->wave.sample_rate = wave->sample_rate;
+  audio->wave.num_samples = static_cast<int32_t>(audio->samples.size());
+
+  SPDLOG_INFO("VAD kept {:.1f}s of {:.1f}s in {} regions ({:.1f}% skipped)",
+              audio->samples.size() / 16000.0f, wave->num_samples / 16000.0f,
+              audio->regions.size(), audio->skipped_fraction() * 100.0f);
+  return audio;
+}
+
+} // namespace vad
@@ -0,0 +1,47 @@
+# Fails unless LIBRARY exports the loud_* C API and nothing else.
+# cmake -DNM=nm -DLIBRARY=build/lib/libloud.so -P tests/check_exports.cmake
+if(CMAKE_HOST_APPLE)
+    set(NM_ARGS -gU)
+else()
+    set(NM_ARGS -D --defined-only)
+endif()
+execute_process(
+    COMMAND ${NM} ${NM_ARGS} ${LIBRARY}
+    OUTPUT_VARIABLE SYMBOLS
+    RESULT_VARIABLE RESULT
+)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${LIBRARY}")
+endif()
+
+string(REPLACE "\n" ";" LINES "${SYMBOLS}")
+set(API "")
+set(LEAKED "")
+foreach(LINE IN LISTS LINES)
+    # Address, type and name
+    if(NOT LINE MATCHES "^[0-9a-fA-F]* *[A-Za-z] ([^ ]+)$")
+        continue()
+    endif()
+    set(NAME ${CMAKE_MATCH_1})
+    # macOS prefixes C names with _
+    if(CMAKE_HOST_APPLE)
+        string(REGEX REPLACE "^_" "" NAME ${NAME})
+    endif()
+    if(NAME MATCHES "^loud_")
+        list(APPEND API ${NAME})
+    else()
+        list(APPEND LEAKED ${NAME})
+    endif()
+endforeach()
+
+list(LENGTH LEAKED NUM_LEAKED)
+if(NUM_LEAKED GREATER 0)
+    list(JOIN LEAKED "\n  " LEAKED)
+    message(FATAL_ERROR "${LIBRARY} exports ${NUM_LEAKED} symbols outside the "
+                        "C API:\n  ${LEAKED}")
+endif()
+list(LENGTH API NUM_API)
+if(NUM_API EQUAL 0)
+    message(FATAL_ERROR "${LIBRARY} exports no loud_* function")
+endif()
+message(STATUS "${LIBRARY} exports only the C API (${NUM_API} functions)")
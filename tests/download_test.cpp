@@ -0,0 +1,237 @@
+// Downloader against a local HTTP server: fresh downloads, resumed .part
+// files, 416 answers and servers that ignore range requests
+#include "download.h"
+#include "sha256.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed"  \
+                << std::endl;                                                  \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// Serves one body over HTTP/1.1, one request per connection. Range requests
+// are answered with 206, or 416 past the end, unless honor_range is off
+class Server {
+public:
+  Server(std::string body, bool honor_range)
+      : body(std::move(body)), honor_range(honor_range) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    listen(fd, 8);
+    socklen_t len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    port = ntohs(addr.sin_port);
+    thread = std::thread([this] { serve(); });
+  }
+
+  ~Server() {
+    stop = true;
+    thread.join();
+    close(fd);
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port) + "/model.bin";
+  }
+
+  // Range header of every request, empty for plain ones
+  std::vector<std::string> ranges() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return seen_ranges;
+  }
+
+private:
+  void serve() {
+    while (!stop) {
+      pollfd pfd{fd, POLLIN, 0};
+      if (poll(&pfd, 1, 50) <= 0) {
+        continue;
+      }
+      int client = accept(fd, nullptr, nullptr);
+      if (client < 0) {
+        continue;
+      }
+      respond(client);
+      close(client);
+    }
+  }
+
+  void respond(int client) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+      ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        return;
+      }
+      request.append(buffer, n);
+    }
+
+    std::string range;
+    auto pos = request.find("Range: bytes=");
+    if (pos != std::string::npos) {
+      pos += 13;
+      range = request.substr(pos, request.find('-', pos) - pos);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      seen_ranges.push_back(range);
+    }
+
+    std::string head;
+    std::string payload;
+    size_t from = range.empty() ? 0 : std::stoul(range);
+    if (!range.empty() && honor_range && from >= body.size()) {
+      head = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" +
+             std::to_string(body.size()) + "\r\nContent-Length: 0\r\n";
+    } else if (!range.empty() && honor_range) {
+      payload = body.substr(from);
+      head = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " +
+             std::to_string(from) + "-" + std::to_string(body.size() - 1) +
+             "/" + std::to_string(body.size()) +
+             "\r\nContent-Length: " + std::to_string(payload.size()) + "\r\n";
+    } else {
+      payload = body;
+      head = "HTTP/1.1 200 OK\r\nContent-Length: " +
+             std::to_string(payload.size()) + "\r\n";
+    }
+    std::string response = head + "Connection: close\r\n\r\n" + payload;
+    size_t sent = 0;
+    while (sent < response.size()) {
+      ssize_t n = send(client, response.data() + sent, response.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n <= 0) {
+        return;
+      }
+      sent += n;
+    }
+  }
+
+  std::string body;
+  bool honor_range;
+  int fd = -1;
+  int port = 0;
+  std::atomic<bool> stop{false};
+  std::thread thread;
+  std::mutex mutex;
+  std::vector<std::string> seen_ranges;
+};
+
+static std::string read_file(const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(ifs), {});
+}
+
+static void write_file(const std::string &path, const std::string &data) {
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs << data;
+}
+
+static std::string digest(const std::string &data) {
+  sha256::Hasher hasher;
+  hasher.update(data.data(), data.size());
+  return hasher.hex_digest();
+}
+
+struct Case {
+  const char *name;
+  bool honor_range;
+  // Left in <path>.part before the download, nullptr for none
+  const char *part;
+  bool wrong_digest;
+  bool expect_success;
+  // Range header the first request must carry, empty for none
+  std::string expect_first_range;
+  size_t expect_requests;
+};
+
+int main() {
+  std::string body;
+  for (int i = 0; i < 100000; i++) {
+    body += static_cast<char>('a' + i % 26);
+  }
+  std::string half = body.substr(0, body.size() / 2);
+  std::string corrupt = body;
+  corrupt[10] = '!';
+  std::string longer = body + "tail";
+
+  auto dir = fs::temp_directory_path() /
+             ("loud-download-test-" + std::to_string(getpid()));
+  fs::create_directories(dir);
+  auto path = (dir / "model.bin").string();
+  auto part_path = path + ".part";
+
+  auto half_range = std::to_string(half.size());
+  auto full_range = std::to_string(body.size());
+  std::vector<Case> cases = {
+      {"fresh download", true, nullptr, false, true, "", 1},
+      {"resume a half .part", true, half.c_str(), false, true, half_range, 1},
+      {"416 on a complete .part", true, body.c_str(), false, true, full_range,
+       1},
+      {"416 on a corrupt .part restarts", true, corrupt.c_str(), false, true,
+       full_range, 2},
+      {"416 past the end restarts", true, longer.c_str(), false, true,
+       std::to_string(longer.size()), 2},
+      {"ignored range restarts", false, half.c_str(), false, true, half_range,
+       2},
+      {"digest mismatch", true, nullptr, true, false, "", 1},
+  };
+
+  for (const auto &c : cases) {
+    std::cout << "-- " << c.name << std::endl;
+    fs::remove(path);
+    fs::remove(part_path);
+    if (c.part) {
+      write_file(part_path, c.part);
+    }
+    Server server(body, c.honor_range);
+    auto sha = c.wrong_digest ? digest(corrupt) : digest(body);
+    bool ok = download::download_file(server.url(), path, sha);
+    auto ranges = server.ranges();
+
+    CHECK(ok == c.expect_success);
+    CHECK(ranges.size() == c.expect_requests);
+    CHECK(!ranges.empty() && ranges.front() == c.expect_first_range);
+    // A restart downloads from byte 0
+    CHECK(ranges.size() < 2 || ranges.back().empty());
+    CHECK(!fs::exists(part_path));
+    if (c.expect_success) {
+      CHECK(read_file(path) == body);
+    } else {
+      CHECK(!fs::exists(path));
+    }
+  }
+
+  fs::remove_all(dir);
+  if (failures) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All download tests passed" << std::endl;
+  return 0;
+}
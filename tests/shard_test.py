@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Shard a recording, process each shard with the mock backends and merge them,
+then compare with processing the whole recording at once.
+
+Each of the 4 speakers is a steady tone in 5 second turns, which the mock
+diarizer and mock_embedding tell apart. The second shard's centroids are
+dropped, so its speech has to go to a speaker of its own.
+
+    python3 tests/shard_test.py build/bin/loud
+"""
+
+import json
+import math
+import subprocess
+import sys
+import tempfile
+import wave
+from array import array
+from pathlib import Path
+
+SAMPLE_RATE = 16000
+DURATION = 100
+TURN = 5
+PITCHES = [300, 500, 700, 900]
+SHARD_SECONDS = 30
+MARGIN = 5
+# Shard whose centroids are left empty
+UNLINKED = 1
+
+MOCK = ["--asr-backend", "mock", "--diarization-backend", "mock",
+        "--mock-asr-rtf", "0", "--mock-diarization-rtf", "0",
+        "--num-speakers", str(len(PITCHES))]
+
+
+def write_tones(path):
+    samples = array("h")
+    for i in range(DURATION * SAMPLE_RATE):
+        t = i / SAMPLE_RATE
+        pitch = PITCHES[int(t // TURN) % len(PITCHES)]
+        samples.append(int(8000 * math.sin(2 * math.pi * pitch * t)))
+    with wave.open(str(path), "wb") as f:
+        f.setnchannels(1)
+        f.setsampwidth(2)
+        f.setframerate(SAMPLE_RATE)
+        f.writeframes(samples.tobytes())
+
+
+def run(*args):
+    print("$", " ".join(str(arg) for arg in args), flush=True)
+    subprocess.run([str(arg) for arg in args], check=True)
+
+
+def main():
+    loud = Path(sys.argv[1]).resolve()
+    failures = []
+
+    def check(cond, message):
+        if not cond:
+            failures.append(message)
+            print("✗", message)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        tmp = Path(tmp)
+        audio = tmp / "tones.wav"
+        write_tones(audio)
+
+        run(loud, audio, "--json", tmp / "whole.json", *MOCK)
+        run(loud, "shard", audio, "--out-dir", tmp / "shards",
+            "--shard-seconds", SHARD_SECONDS, "--margin", MARGIN)
+        manifest = json.loads((tmp / "shards" / "shards.json").read_text())
+        shards = manifest["shards"]
+        check(len(shards) == math.ceil(DURATION / SHARD_SECONDS),
+              f"{len(shards)} shards")
+        for shard in shards:
+            run(loud, tmp / "shards" / shard["audio"],
+                "--json", tmp / "shards" / shard["json"],
+                "--centroids", tmp / "shards" / shard["centroids"], *MOCK)
+        (tmp / "shards" / shards[UNLINKED]["centroids"]).write_text("{}")
+        run(loud, "merge", tmp / "shards" / "shards.json",
+            "--json", tmp / "merged.json")
+
+        whole = json.loads((tmp / "whole.json").read_text())
+        merged = json.loads((tmp / "merged.json").read_text())
+
+    check(len(merged) == len(whole),
+          f"{len(merged)} merged segments, {len(whole)} unsharded")
+    own_start = UNLINKED * SHARD_SECONDS
+    own_end = own_start + SHARD_SECONDS
+    mapping = {}
+    unlinked = set()
+    for m, w in zip(merged, whole):
+        where = f"segment at {w['start']:.2f}s"
+        check(abs(m["start"] - w["start"]) < 0.01 and
+              abs(m["end"] - w["end"]) < 0.01,
+              f"{where} is {m['start']:.2f}-{m['end']:.2f}s merged, "
+              f"{w['start']:.2f}-{w['end']:.2f}s unsharded")
+        # Shards are requantized to 16 bit, so the mock text only keeps its
+        # length
+        check(len(m["text"].split()) == len(w["text"].split()),
+              f"{where} has different text lengths")
+        if own_start <= (w["start"] + w["end"]) / 2 < own_end:
+            unlinked.add(m["speaker"])
+            continue
+        mapping.setdefault(m["speaker"], set()).add(w["speaker"])
+
+    check(all(len(speakers) == 1 for speakers in mapping.values()),
+          f"merged speakers are a mix of unsharded ones: {mapping}")
+    check(len(mapping) == len(PITCHES),
+          f"{len(mapping)} linked speakers, expected {len(PITCHES)}")
+    check(len(unlinked) == 1 and not unlinked & mapping.keys(),
+          f"shard without centroids got speakers {unlinked}, linked ones "
+          f"are {sorted(mapping)}")
+
+    if failures:
+        print(f"{len(failures)} check(s) failed")
+        return 1
+    print("Sharded and unsharded results match")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,201 @@
+// Measure pipeline overhead and concurrency scaling on mock backends,
+// compare asr backends on real audio, or measure how windowed diarization
+// scales with its workers
+#include "CLI/CLI.hpp"
+#include "config.h"
+#include "diarization.h"
+#include "pipeline.h"
+#include "spdlog/spdlog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"Loud.cpp pipeline benchmark\nRuns concurrent engines on mock "
+               "backends, so only the pipeline itself is measured\n"};
+
+  std::string audio_file;
+  std::string asr_backend = "mock";
+  std::string whisper_model_path = config::ggml_tiny_name;
+  std::string sherpa_asr_model_path;
+  std::string sherpa_asr_model_type = "sense_voice";
+  int32_t asr_batch_size = 16;
+  std::vector<int32_t> diarization_workers;
+  float diarization_window = 600.0f;
+  int32_t onnx_num_threads = 0;
+
+  std::vector<int32_t> streams = {1, 2, 4, 8};
+  float audio_seconds = 600.0f;
+  float mock_asr_rtf = 0.01f;
+  float mock_diarization_rtf = 0.005f;
+  int32_t num_speakers = 2;
+
+  app.add_option("--streams", streams,
+                 "Numbers of concurrent engines to run (Default: 1 2 4 8)");
+  app.add_option("--audio-seconds", audio_seconds,
+                 "Length of the synthetic audio of each stream (Default: "
+                 "600)");
+  app.add_option("--mock-asr-rtf", mock_asr_rtf,
+                 "Real time factor of the mock asr backend (Default: 0.01)");
+  app.add_option("--mock-diarization-rtf", mock_diarization_rtf,
+                 "Real time factor of the mock diarization backend (Default: "
+                 "0.005)");
+  app.add_option("--num-speakers", num_speakers,
+                 "Speakers the mock diarizer cycles through (Default: 2)");
+  app.add_option("--audio", audio_file,
+                 "Audio file to use instead of synthetic noise");
+  app.add_option("--asr-backend", asr_backend,
+                 "Speech to text backend to measure, diarization stays mock "
+                 "(Default: mock)")
+      ->check(CLI::IsMember({"whisper", "sherpa", "mock"}));
+  app.add_option("--whisper-model", whisper_model_path, "Path to the model");
+  app.add_option("--sherpa-asr-model", sherpa_asr_model_path,
+                 "Directory of the sherpa-onnx offline model");
+  app.add_option("--sherpa-asr-model-type", sherpa_asr_model_type,
+                 "Type of the sherpa-onnx offline model (Default: "
+                 "sense_voice)");
+  app.add_option("--asr-batch-size", asr_batch_size,
+                 "Segments decoded per call by sherpa (Default: 16)");
+  app.add_option("--diarization-workers", diarization_workers,
+                 "Run windowed sherpa diarization of --audio with each number "
+                 "of workers instead");
+  app.add_option("--diarization-window", diarization_window,
+                 "Window of --diarization-workers in seconds (Default: 600)");
+  app.add_option("--onnx-num-threads", onnx_num_threads,
+                 "Onnx threads shared by the diarization workers (Default: "
+                 "number of cores)");
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+  spdlog::set_level(spdlog::level::warn);
+
+  // Deterministic noise, the mock transcriber hashes it into words
+  std::vector<float> samples(static_cast<size_t>(audio_seconds * 16000));
+  uint32_t seed = 1;
+  for (auto &sample : samples) {
+    seed = seed * 1664525u + 1013904223u;
+    sample = static_cast<float>(seed >> 8) / (1u << 24) - 0.5f;
+  }
+  SherpaOnnxWave noise;
+  noise.samples = samples.data();
+  noise.sample_rate = 16000;
+  noise.num_samples = static_cast<int32_t>(samples.size());
+  const SherpaOnnxWave *wave = &noise;
+  std::unique_ptr<diarization::Audio> audio;
+  if (!audio_file.empty()) {
+    audio = diarization::prepare_audio_file(audio_file, argc, argv);
+    if (!audio) {
+      return EXIT_FAILURE;
+    }
+    wave = audio->wave();
+    audio_seconds = wave->num_samples / 16000.0f;
+  }
+
+  if (!diarization_workers.empty()) {
+    if (!audio) {
+      std::cerr << "--diarization-workers needs --audio" << std::endl;
+      return EXIT_FAILURE;
+    }
+    diarization::WindowedConfig config;
+    config.segmentation_model_path = config::segmentation_name;
+    config.embedding_model_path = config::embedding_name;
+    config.provider = diarization::get_default_provider();
+    config.num_clusters = num_speakers;
+    config.window_seconds = diarization_window;
+    config.onnx_num_threads =
+        onnx_num_threads > 0
+            ? onnx_num_threads
+            : static_cast<int32_t>(std::thread::hardware_concurrency());
+
+    std::cout << "workers  wall(s)  rtf     speakers  scaling" << std::endl;
+    double single_wall = 0.0;
+    for (auto n : diarization_workers) {
+      config.num_workers = n;
+      progress::Stage stage;
+      std::vector<diarization::DiarizationSegment> segments;
+      auto start_time = std::chrono::steady_clock::now();
+      if (!diarization::run_windowed_diarization("", config, wave, stage,
+                                                 segments)) {
+        return EXIT_FAILURE;
+      }
+      double wall = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+      int32_t speakers = 0;
+      for (const auto &segment : segments) {
+        speakers = std::max(speakers, segment.speaker + 1);
+      }
+      if (single_wall == 0.0) {
+        single_wall = wall;
+      }
+      std::cout << fmt::format("{:7}  {:7.2f}  {:6.3f}  {:8}  {:7.2f}", n,
+                               wall, wall / audio_seconds, speakers,
+                               single_wall / wall)
+                << std::endl;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  pipeline::Options options;
+  options.asr_backend = asr_backend;
+  options.whisper_model_path = whisper_model_path;
+  options.sherpa_asr_model_path = sherpa_asr_model_path;
+  options.sherpa_asr_model_type = sherpa_asr_model_type;
+  options.asr_batch_size = asr_batch_size;
+  options.diarization_backend = "mock";
+  options.mock_asr_rtf = mock_asr_rtf;
+  options.mock_diarization_rtf = mock_diarization_rtf;
+  options.num_speakers = num_speakers;
+  // What the mocks sleep, anything above it is pipeline overhead. With a
+  // real asr backend it's included in the overhead, which then compares
+  // backends: the mock diarizer's fixed turns are transcribed by each
+  double model_seconds =
+      audio_seconds *
+      ((asr_backend == "mock" ? mock_asr_rtf : 0.0f) + mock_diarization_rtf);
+
+  std::cout << "streams  wall(s)  overhead(s)  audio/s  scaling" << std::endl;
+  double single_throughput = 0.0;
+  for (auto n : streams) {
+    // Engines serialize their calls, so each stream gets its own
+    std::vector<std::unique_ptr<pipeline::Engine>> engines;
+    for (int32_t i = 0; i < n; i++) {
+      engines.push_back(std::make_unique<pipeline::Engine>(options));
+      if (!engines.back()->load()) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto &engine : engines) {
+      threads.emplace_back([&engine, wave] {
+        nlohmann::ordered_json result;
+        engine->process(wave, result);
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    double wall = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start_time)
+                      .count();
+
+    double throughput = n * audio_seconds / wall;
+    if (single_throughput == 0.0) {
+      single_throughput = throughput;
+    }
+    std::cout << fmt::format("{:7}  {:7.2f}  {:11.3f}  {:7.0f}  {:7.2f}", n,
+                             wall, wall - model_seconds, throughput,
+                             throughput / single_throughput)
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+// Measure the lookup latency of the enrolled speaker index as the roster
+// grows, for the float and int8 scans
+#include "CLI/CLI.hpp"
+#include "dsp.h"
+#include "speakers.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Deterministic embedding, roughly gaussian so rows look like real ones
+static std::vector<float> random_embedding(uint32_t &seed, int32_t dim) {
+  std::vector<float> embedding(dim);
+  for (auto &value : embedding) {
+    float sum = 0.0f;
+    for (int32_t i = 0; i < 4; i++) {
+      seed = seed * 1664525u + 1013904223u;
+      sum += static_cast<float>(seed >> 8) / (1u << 24) - 0.5f;
+    }
+    value = sum;
+  }
+  return embedding;
+}
+
+// Mean milliseconds per search of the queries, and how many found the
+// speaker they were taken from
+template <typename Search>
+static std::pair<double, int32_t>
+measure(const std::vector<std::vector<float>> &queries,
+        const std::vector<int32_t> &expected, Search search) {
+  int32_t found = 0;
+  auto start_time = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < queries.size(); i++) {
+    found += search(queries[i]).index == expected[i];
+  }
+  double elapsed = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count();
+  return {elapsed / queries.size(), found};
+}
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"Loud.cpp speaker index benchmark\nEnrolls random speakers "
+               "and times searching the index for them\n"};
+
+  std::vector<int32_t> rosters = {1000, 10000, 100000};
+  int32_t dim = 192;
+  int32_t num_queries = 100;
+  float noise = 0.3f;
+
+  app.add_option("--speakers", rosters,
+                 "Roster sizes to measure, in increasing order (Default: "
+                 "1000 10000 100000)");
+  app.add_option("--dim", dim,
+                 "Embedding dimension (Default: 192, as titanet small)");
+  app.add_option("--queries", num_queries,
+                 "Searches timed per roster size (Default: 100)");
+  app.add_option("--noise", noise,
+                 "Noise added to the enrolled embedding of each query "
+                 "(Default: 0.3)");
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+  std::sort(rosters.begin(), rosters.end());
+
+  speakers::SpeakerIndex index;
+  std::vector<std::vector<float>> enrolled;
+  uint32_t seed = 1;
+
+  std::cout << "simd: " << dsp::simd_path() << std::endl;
+  std::cout << "speakers  float(ms)  int8(ms)  float hits  int8 hits"
+            << std::endl;
+  for (auto size : rosters) {
+    while (static_cast<int32_t>(index.size()) < size) {
+      enrolled.push_back(random_embedding(seed, dim));
+      if (!index.enroll("speaker_" + std::to_string(index.size()),
+                        enrolled.back())) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Queries are noisy copies of enrolled speakers spread over the roster
+    std::vector<std::vector<float>> queries;
+    std::vector<int32_t> expected;
+    for (int32_t i = 0; i < num_queries; i++) {
+      int32_t speaker =
+          static_cast<int32_t>(static_cast<int64_t>(i) * size / num_queries);
+      auto query = random_embedding(seed, dim);
+      for (int32_t d = 0; d < dim; d++) {
+        query[d] = enrolled[speaker][d] + noise * query[d];
+      }
+      queries.push_back(query);
+      expected.push_back(speaker);
+    }
+
+    auto [float_ms, float_hits] =
+        measure(queries, expected,
+                [&](const std::vector<float> &q) { return index.search(q); });
+    auto [int8_ms, int8_hits] = measure(
+        queries, expected,
+        [&](const std::vector<float> &q) { return index.search_int8(q); });
+    std::cout << fmt::format("{:8}  {:9.3f}  {:8.3f}  {:10}  {:9}", size,
+                             float_ms, int8_ms, float_hits, int8_hits)
+              << std::endl;
+  }
+  return EXIT_SUCCESS;
+}
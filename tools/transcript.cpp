@@ -0,0 +1,93 @@
+// Inspect binary transcripts and convert them to and from JSON
+#include "CLI/CLI.hpp"
+#include "transcript.h"
+#include "utils.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+static void print_segment(const transcript::Segment &segment) {
+  std::cout << "[" << segment.start << " - " << segment.end << "] ";
+  if (!segment.speaker_name.empty()) {
+    std::cout << segment.speaker_name;
+  } else {
+    std::cout << "Speaker " << segment.speaker;
+  }
+  std::cout << ": " << segment.text << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"Loud.cpp transcript tool\nRead and convert binary "
+               "transcripts (--transcript)\n"};
+  app.require_subcommand(1);
+
+  std::string path;
+  float seconds = 0.0f;
+  std::string output;
+
+  auto *info = app.add_subcommand("info", "Show the number of segments");
+  info->add_option("transcript", path, "Path to the transcript")
+      ->required()
+      ->check(CLI::ExistingFile);
+
+  auto *print = app.add_subcommand("print", "Print all segments");
+  print->add_option("transcript", path, "Path to the transcript")
+      ->required()
+      ->check(CLI::ExistingFile);
+
+  auto *at = app.add_subcommand("at", "Print what was said at a time");
+  at->add_option("transcript", path, "Path to the transcript")
+      ->required()
+      ->check(CLI::ExistingFile);
+  at->add_option("seconds", seconds, "Time in seconds")->required();
+
+  auto *to_json = app.add_subcommand("to-json", "Convert to loud JSON");
+  to_json->add_option("transcript", path, "Path to the transcript")
+      ->required()
+      ->check(CLI::ExistingFile);
+  to_json->add_option("json", output, "Path to save the JSON")->required();
+
+  auto *from_json = app.add_subcommand("from-json", "Convert loud JSON");
+  from_json->add_option("json", path, "Path to the JSON")
+      ->required()
+      ->check(CLI::ExistingFile);
+  from_json->add_option("transcript", output, "Path to save the transcript")
+      ->required();
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+
+  if (from_json->parsed()) {
+    std::ifstream input(path);
+    auto result = nlohmann::ordered_json::parse(input, nullptr, false);
+    if (!result.is_array()) {
+      std::cerr << path << " is not a loud JSON result" << std::endl;
+      return EXIT_FAILURE;
+    }
+    return transcript::save(output, result) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  transcript::Reader reader;
+  if (!reader.open(path)) {
+    std::cerr << "Error: Could not read " << path << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (info->parsed()) {
+    std::cout << reader.size() << " segments" << std::endl;
+  } else if (print->parsed()) {
+    for (uint32_t i = 0; i < reader.size(); i++) {
+      print_segment(reader.segment(i));
+    }
+  } else if (at->parsed()) {
+    for (auto index : reader.at(seconds)) {
+      print_segment(reader.segment(index));
+    }
+  } else if (to_json->parsed()) {
+    utils::save_json(output, reader.to_json());
+  }
+  return EXIT_SUCCESS;
+}